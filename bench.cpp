@@ -0,0 +1,244 @@
+/**
+ * Headless benchmark of the simulation: runs a flock for a number of
+ * steps without rendering and reports the throughput.
+ */
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+#include "flock.hpp"
+#include "kernels.hpp"
+#include "random.hpp"
+
+static void usage(const char *program)
+{
+    std::cerr << "Usage: " << program << " [options]\n"
+              << "  -n, --boids N      Number of boids (default 10000)\n"
+              << "  -s, --steps K      Number of steps (default 100)\n"
+              << "  -r, --seed S       Random seed (default 1)\n"
+              << "  -t, --threads T    Number of threads (default 1)\n"
+              << "  -i, --index NAME   kdtree, implicit, grid or brute\n"
+              << "                     (default kdtree)\n"
+              << "  -w, --wrap         Wrap around the edges\n"
+              << "  -k, --nearest K    Only the K nearest boids interact\n"
+              << "  -p, --species P    Split the boids into P species, each\n"
+              << "                     fleeing the next one (default 1)\n"
+              << "      --separate     One neighborhood query per rule\n"
+              << "      --double-buffer  Steer from the previous step\n"
+              << "      --per-boid   One index search per boid, not batched\n"
+              << "      --refit T    Refit the index, rebuilding nodes whose\n"
+              << "                   halves overlap by T of their extent\n"
+              << "      --scalar     Disable the vectorized kernels\n"
+              << "      --profile    Time the phases of each step\n"
+              << "      --check-kernels  Compare the vectorized kernels to\n"
+              << "                     the scalar ones on random inputs\n";
+}
+
+/**
+ * Runs kernels::accumulate with both instruction sets on random
+ * neighborhoods, with and without species, predators and wrapping, and
+ * counts the results that differ. Returns the number of mismatches.
+ */
+static unsigned checkKernels(uint64_t seed)
+{
+    Random::Stream random = Random(seed).stream(0);
+    const unsigned size = 1000;
+    Kinematics state;
+    std::vector<uint8_t> flags(size), kinds(size);
+    for (unsigned i = 0; i < size; i++) {
+        state.push(Vector(random.uniform(), random.uniform()),
+                   Vector(random.uniform(0.002, -0.001),
+                          random.uniform(0.002, -0.001)));
+        flags[i] = random.uniform() < 0.125 ? Flock::Predator : 0;
+        kinds[i] = random.next() % 4;
+    }
+
+    auto run = [&](kernels::Isa isa, const kernels::Interactions &with,
+                   const std::vector<unsigned> &neighbors, unsigned self,
+                   const kernels::Radii &radii, bool wrap) {
+        kernels::select(isa);
+        kernels::Neighborhood out;
+        kernels::accumulate(state, with, neighbors.data(), neighbors.size(),
+                            state.x[self], state.y[self], radii, wrap, out);
+        return out;
+    };
+    auto close = [](real a, real b) {
+        return std::fabs(a - b) <= 1e-4 * (1 + std::fabs(a));
+    };
+
+    kernels::Isa previous = kernels::current();
+    unsigned mismatches = 0;
+    for (unsigned trial = 0; trial < 10000; trial++) {
+        bool wrap = trial & 1;
+        unsigned self = random.next() % size;
+        std::vector<unsigned> neighbors(random.next() % 40);
+        for (auto &neighbor : neighbors) neighbor = random.next() % size;
+
+        kernels::Radii radii;
+        real *squared[] = {&radii.cohesion2, &radii.separation2,
+                           &radii.alignment2, &radii.fear2};
+        for (real *radius2 : squared) *radius2 = random.uniform(0.25);
+
+        kernels::Interactions with;
+        with.flags = flags.data();
+        with.predator = Flock::Predator;
+        if (trial & 2) {
+            with.species = kinds.data();
+            with.flock = random.next() & 0xf;
+            with.flee = random.next() & 0xf;
+        }
+
+        auto a = run(kernels::Isa::Scalar, with, neighbors, self, radii, wrap);
+        auto b = run(kernels::Isa::AVX2, with, neighbors, self, radii, wrap);
+        if (!close(a.centerX, b.centerX) || !close(a.centerY, b.centerY) ||
+            !close(a.awayX, b.awayX) || !close(a.awayY, b.awayY) ||
+            !close(a.sumX, b.sumX) || !close(a.sumY, b.sumY) ||
+            !close(a.predatorX, b.predatorX) ||
+            !close(a.predatorY, b.predatorY) || a.cohesive != b.cohesive ||
+            a.aligned != b.aligned || a.predators != b.predators)
+            mismatches++;
+    }
+    kernels::select(previous);
+    return mismatches;
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned boids = 10000, steps = 100, seed = 1, threads = 1, nearest = 0;
+    unsigned species = 1;
+    bool wrap = false, separate = false, doubleBuffer = false, scalar = false;
+    bool profile = false, perBoid = false, checking = false;
+    double refit = -1;
+    std::string index = "kdtree";
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        auto value = [&]() -> const char * {
+            if (i + 1 >= argc) {
+                usage(argv[0]);
+                std::exit(1);
+            }
+            return argv[++i];
+        };
+
+        if (arg == "-n" || arg == "--boids") boids = std::atoi(value());
+        else if (arg == "-s" || arg == "--steps") steps = std::atoi(value());
+        else if (arg == "-r" || arg == "--seed") seed = std::atoi(value());
+        else if (arg == "-t" || arg == "--threads") threads = std::atoi(value());
+        else if (arg == "-i" || arg == "--index") index = value();
+        else if (arg == "-w" || arg == "--wrap") wrap = true;
+        else if (arg == "-k" || arg == "--nearest") nearest = std::atoi(value());
+        else if (arg == "-p" || arg == "--species") species = std::atoi(value());
+        else if (arg == "--separate") separate = true;
+        else if (arg == "--double-buffer") doubleBuffer = true;
+        else if (arg == "--per-boid") perBoid = true;
+        else if (arg == "--refit") refit = std::atof(value());
+        else if (arg == "--scalar") scalar = true;
+        else if (arg == "--profile") profile = true;
+        else if (arg == "--check-kernels") checking = true;
+        else {
+            usage(argv[0]);
+            return arg == "-h" || arg == "--help" ? 0 : 1;
+        }
+    }
+
+    if ((index != "kdtree" && index != "implicit" && index != "grid" &&
+         index != "brute") ||
+        species < 1 || species > Flock::maxSpecies) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (checking) {
+        if (kernels::detect() == kernels::Isa::Scalar) {
+            std::cout << "kernels:            scalar only, nothing to check\n";
+            return 0;
+        }
+        unsigned mismatches = checkKernels(seed);
+        std::cout << "kernel mismatches:  " << mismatches << "\n";
+        return mismatches ? 1 : 0;
+    }
+
+    if (scalar) kernels::select(kernels::Isa::Scalar);
+
+    SpatialIndex::Type type = SpatialIndex::Type::KDTree;
+    if (index == "implicit") type = SpatialIndex::Type::ImplicitKDTree;
+    if (index == "grid") type = SpatialIndex::Type::Grid;
+    Flock flock(species > 1 ? 0 : boids, type, seed);
+
+    // Faster species preying on the previous ones
+    for (unsigned p = 1; p < species; p++) {
+        Species parameters = flock;
+        parameters.maxVelocity *= 1 + double(p) / species;
+        parameters.cohesionRadius *= 1 + 0.5 * p / species;
+        flock.addSpecies(parameters);
+        flock.setRelation(p - 1, p, Flock::Relation::Flee);
+    }
+    for (unsigned p = 0; p < species && species > 1; p++)
+        flock.resize(boids * (p + 1) / species - boids * p / species, p);
+    flock.bruteForce = index == "brute";
+    flock.wrap = wrap;
+    flock.topological = nearest;
+    flock.fused = !separate;
+    flock.doubleBuffer = doubleBuffer;
+    flock.batchQueries = !perBoid;
+    flock.refitThreshold = refit;
+    flock.countQueries = true;
+    flock.setThreads(threads);
+
+    Profiler profiler(steps);
+    if (profile) flock.profiler = &profiler;
+
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned step = 0; step < steps; step++) flock.compute();
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+
+    // Order-independent digest of the final state, to compare variants
+    auto &state = flock.kinematics();
+    double checksum = 0;
+    for (unsigned i = 0; i < state.size(); i++)
+        checksum += state.x[i] + state.y[i];
+
+    auto stats = flock.statistics();
+    double seconds = elapsed.count();
+    double boidSteps = static_cast<double>(boids) * steps;
+
+    std::cout << "boids:              " << boids << "\n"
+              << "steps:              " << steps << "\n"
+              << "threads:            " << flock.threads() << "\n"
+              << "index:              " << index << (wrap ? " (wrap)" : "") << "\n"
+              << "nearest:            " << (nearest ? std::to_string(nearest) : "all") << "\n"
+              << "species:            " << flock.speciesCount() << "\n"
+              << "kernels:            " << kernels::name(kernels::current()) << "\n"
+              << "elapsed:            " << seconds << " s\n"
+              << "steps/s:            " << steps / seconds << "\n"
+              << "ns per boid-step:   " << seconds * 1e9 / boidSteps << "\n"
+              << "queries:            " << stats.queries << "\n"
+              << "candidates/query:   "
+              << (stats.queries ? double(stats.candidates) / stats.queries : 0) << "\n"
+              << "neighbors/query:    "
+              << (stats.queries ? double(stats.neighbors) / stats.queries : 0) << "\n"
+              << "checksum:           " << std::setprecision(15) << checksum << "\n";
+
+    if (refit >= 0) {
+        auto &updates = stats.index;
+        double rebuilt = updates.refits
+                             ? double(updates.rebuilt) / updates.refits / boids
+                             : 0;
+        std::cout << "builds:             " << updates.builds << "\n"
+                  << "refits:             " << updates.refits << "\n"
+                  << "subtrees rebuilt:   " << updates.rebuilds << " ("
+                  << std::setprecision(3) << rebuilt * 100
+                  << "% of the boids per refit)\n";
+    }
+
+    if (profile) {
+        std::cout << "\n";
+        profiler.dump(std::cout);
+    }
+}
@@ -1,28 +1,36 @@
 #include "flock.hpp"
 #include "boid.hpp"
+#include "kernels.hpp"
+#include "spatial-index.hpp"
 #include "vector.hpp"
 
-#include <SFML/Graphics.hpp>
-#include <deque>
 #include <functional>
 #include <math.h>
 
-Boid::Boid(Flock &flock, const Vector &position, bool isPredator=false) :
-    flock(flock), 
-    isPredator(isPredator)
+Boid::Boid(Flock &flock, unsigned index) :
+    Mobile(flock.state, index),
+    flock(&flock),
+    heading(velocity())
 {
-    this->position = position;
-    velocity = Vector::random(flock.maxVelocity * 2.0, -flock.maxVelocity);
 }
 
-Boid::Boid(Flock &flock, int x, int y, bool isPredator) :
-    Boid(flock, Vector(x, y), isPredator)
+bool Boid::isPredator() const
 {
+    return flock->flags[index] & Flock::Predator;
 }
 
-Boid::Boid(Flock &flock, bool isPredator) :
-    Boid(flock, Vector::random(), isPredator)
+unsigned Boid::species() const { return flock->kinds[index]; }
+
+bool Boid::flocksWith(const Boid &other) const
+{
+    return flock->relation(species(), other.species()) ==
+           Flock::Relation::Flock;
+}
+
+bool Boid::flees(const Boid &other) const
 {
+    return other.isPredator() || flock->relation(species(), other.species()) ==
+                                     Flock::Relation::Flee;
 }
 
 /**
@@ -32,13 +40,18 @@ void Boid::cohesion(float radius, float weight)
 {
     // Center of the group
     Vector center{0, 0};
-    int neighbors = inSight([&](Boid other) { 
-        center += other.position; 
+    int neighbors = 0;
+    inSight([&](Boid &other) { 
+        if (!flocksWith(other)) return;
+        center += imageOf(other, flock->wrap);
+        neighbors++;
     }, radius);
     center /= neighbors;
 
     // Stir to the center
-    velocity += neighbors > 0 ? (center - position) * weight : Vector(0, 0);
+    Vector velocity = this->velocity();
+    velocity += neighbors > 0 ? (center - position()) * weight : Vector(0, 0);
+    setVelocity(velocity);
 }
 
 /**
@@ -47,12 +60,13 @@ void Boid::cohesion(float radius, float weight)
 void Boid::separation(float separationRadius, float separationStrength)
 {
     Vector m{0, 0};
+    Vector position = this->position();
 
-    inSight([&](Boid other) { 
-        m += position - other.position; 
-    }, flock.separationRadius);
+    inSight([&](Boid &other) { 
+        if (flocksWith(other)) m += position - imageOf(other, flock->wrap);
+    }, separationRadius);
 
-    velocity += m * flock.separation;
+    setVelocity(velocity() + m * separationStrength);
 }
 
 /**
@@ -62,54 +76,175 @@ void Boid::alignment(float alignmentRadius, float alignmentStrength)
 {
     Vector sum;
 
-    int neighbors = inSight(
-        [&](Boid other) {
-            sum += other.velocity;
+    int neighbors = 0;
+    inSight(
+        [&](Boid &other) {
+            if (!flocksWith(other)) return;
+            sum += other.velocity();
             neighbors++;
         },
         alignmentRadius);
 
+    Vector velocity = this->velocity();
     velocity += neighbors > 0 ? (sum / neighbors - velocity) * alignmentStrength : Vector(0, 0);
+    setVelocity(velocity);
 }
 
 /**
  * Move away from nearby predators.
  */
 void Boid::fear(float radius, float weight) {
-    auto pos = Vector(0, 0);
-    pos /= inSight([&](Boid other) { 
-        pos += other.isPredator ? other.position : Vector(0, 0);
+    Vector pos{0, 0};
+    int predators = 0;
+    inSight([&](Boid &other) { 
+        if (!flees(other)) return;
+        pos += imageOf(other, flock->wrap);
+        predators++;
     }, radius);
 
-    pos -= position;
-    pos.normalize();
+    // Flee from the predators' centroid
+    Vector velocity = this->velocity();
+    velocity += predators > 0 ? (position() - pos / predators) * weight : Vector(0, 0);
+    setVelocity(velocity);
+}
 
-    position.rotate(pos.angle() * weight);
+/**
+ * Fused evaluation of the rules: one query at the largest radius, each
+ * neighbor being accumulated by the rules whose radius it falls within.
+ * The contributions are applied in the same order as the separate rules
+ * so both give the same steering.
+ */
+Vector Boid::flocking() { return flocking(flock->rules[species()]); }
+
+Vector Boid::flocking(const Rules &rules)
+{
+    thread_local std::vector<unsigned> neighbors;
+    neighbors.clear();
+    inSight(neighbors, rules.maxRadius, rules);
+
+    Vector position = this->position();
+    kernels::Neighborhood n;
+    kernels::accumulate(*state, rules.interactions, neighbors.data(),
+                        neighbors.size(), position.x, position.y,
+                        rules.radii, flock->wrap, n);
+
+    Vector velocity = this->velocity();
+    if (n.cohesive > 0)
+        velocity += (Vector(n.centerX, n.centerY) / n.cohesive - position) * rules.cohesion;
+    velocity += Vector(n.awayX, n.awayY) * rules.separation;
+    if (n.aligned > 0)
+        velocity += (Vector(n.sumX, n.sumY) / n.aligned - velocity) * rules.alignment;
+    if (n.predators > 0)
+        velocity += (position - Vector(n.predatorX, n.predatorY) / n.predators) * rules.fear;
+    return velocity;
 }
 
-void Boid::update()
+void Boid::steer() { steer(flock->rules[species()]); }
+
+void Boid::steer(const Rules &rules)
 {
-    // cohesion(flock.cohesionRadius, flock.cohesion);
-    // separation(flock.separationRadius, flock.separation);
-    // alignment(flock.alignmentRadius, flock.alignment);
-    // fear(flock.fearRadius, flock.fear);
+    if (flock->fused) {
+        setVelocity(flocking(rules));
+        return;
+    }
+
+    const Species &p = *rules.species;
+    cohesion(p.cohesionRadius, rules.cohesion);
+    separation(p.separationRadius, rules.separation);
+    alignment(p.alignmentRadius, rules.alignment);
+    fear(p.fearRadius, rules.fear);
+}
 
-    Mobile::update();
+void Boid::move()
+{
+    Mobile::update(flock->species(species()).maxVelocity, flock->wrap,
+                   flock->timeStep);
 }
 
-int Boid::inSight(std::function<const void(Boid &boid)> callback, float radius)
+void Boid::update()
 {
-    float amin = velocity.angle() - flock.fieldOfView / 2;
-    float amax = velocity.angle() + flock.fieldOfView / 2;
+    steer();
+    move();
+}
 
-    int neighbors = 0;
-    flock.each([&](Boid &other) {
-        float a = angleTo(other);
-        if (distanceTo(other) < radius && a > amin && a < amax) {
-            callback(other);
-            neighbors++;
+/**
+ * Collect the indices of the neighbors within a radius and in the field
+ * of view. The candidates come from the flock's spatial index, or from a
+ * scan of the whole flock when brute force is requested (or when the
+ * space wraps around and the index only knows about planar distances).
+ * The field of view is a cone around the heading, see kernels::visible.
+ * With Flock::topological, only the nearest candidates are looked at.
+ */
+unsigned Boid::inSight(std::vector<unsigned> &neighbors, float radius)
+{
+    return inSight(neighbors, radius, flock->rules[species()]);
+}
+
+unsigned Boid::inSight(std::vector<unsigned> &neighbors, float radius,
+                       const Rules &rules)
+{
+    real norm = heading.norm();
+    kernels::Cone cone;
+    cone.x = position().x;
+    cone.y = position().y;
+    cone.hx = norm > 0 ? heading.x / norm : 1;
+    cone.hy = norm > 0 ? heading.y / norm : 0;
+    cone.cosine = rules.fieldOfViewCosine;
+    cone.radius2 = radius * radius;
+
+    // With topological interaction, the k nearest and the boid itself
+    unsigned k = flock->topological;
+    thread_local std::vector<unsigned> candidates;
+    candidates.clear();
+    const unsigned *list = nullptr;
+    unsigned found = 0;
+    if (radius <= flock->batchRadius &&
+        index + 1 < flock->batchOffsets.size()) {
+        // Already searched by the flock, the kernel narrows the radius
+        list = flock->batchNeighbors.data() + flock->batchOffsets[index];
+        found = flock->batchOffsets[index + 1] - flock->batchOffsets[index];
+    } else if (flock->bruteForce || (flock->wrap && !flock->index->periodic())) {
+        if (k) {
+            thread_local std::vector<std::pair<double, unsigned>> closest;
+            closest.clear();
+            for (unsigned i = 0; i < flock->size(); i++) {
+                double d2 = distance2To(Mobile(flock->state, i), flock->wrap);
+                if (d2 < cone.radius2) closest.emplace_back(d2, i);
+            }
+            SpatialIndex::keepNearest(closest, k + 1, candidates);
+        } else {
+            candidates.resize(flock->size());
+            for (unsigned i = 0; i < candidates.size(); i++) candidates[i] = i;
         }
-    });
-    return neighbors;
+    } else if (k) {
+        flock->index->nearest(position(), k + 1, radius, candidates);
+    } else {
+        flock->index->search(position(), radius, candidates);
+    }
+    if (!list) {
+        list = candidates.data();
+        found = candidates.size();
+    }
+
+    unsigned first = neighbors.size();
+    neighbors.resize(first + found);
+    unsigned count = kernels::visible(flock->state, list, found, index, cone,
+                                      flock->wrap, neighbors.data() + first);
+    neighbors.resize(first + count);
+
+    if (flock->countQueries) {
+        flock->queries.fetch_add(1, std::memory_order_relaxed);
+        flock->candidates.fetch_add(found, std::memory_order_relaxed);
+        flock->neighbors.fetch_add(count, std::memory_order_relaxed);
+    }
+
+    return count;
 }
 
+/**
+ * Visit the neighbors within a radius and in the field of view.
+ */
+int Boid::inSight(std::function<void(Boid &boid)> callback, float radius)
+{
+    return inSight<std::function<void(Boid &boid)> &>(callback, radius);
+}
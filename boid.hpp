@@ -1,24 +1,51 @@
 #pragma once
 
-#include "flock.hpp"
+#include "kernels.hpp"
 #include "mobile.hpp"
+#include "species.hpp"
 #include "vector.hpp"
 
 #include <functional>
+#include <vector>
 
 class Flock;
 
+/**
+ * Handle on one boid of a flock. The state itself lives in the flock's
+ * arrays so a Boid is cheap to copy.
+ */
 class Boid : public Mobile {   
-    int size;
+    Flock *flock; // Friend reference
 
-    bool isPredator;
-
-    Flock &flock; // Friend reference
+    // Heading used by the field of view, captured when the handle is made
+    // so that all the rules of a step see the same neighbors.
+    Vector heading;
 
 public:
-    Boid(Flock &flock, bool isPredator=false);
-    Boid(Flock &flock, int x, int y, bool isPredator=false);
-    Boid(Flock &flock, const Vector &position, bool isPredator=false);
+    /**
+     * Parameters of a species as the steering uses them, prepared by the
+     * flock once per step rather than for every boid.
+     */
+    struct Rules {
+        const Species *species;
+        kernels::Radii radii;
+        real cohesion, separation, alignment, fear;
+        real fieldOfViewCosine;
+        double maxRadius, maxVelocity;
+        kernels::Interactions interactions;
+    };
+
+    Boid(Flock &flock, unsigned index);
+
+    bool isPredator() const;
+    unsigned species() const;
+
+    /**
+     * Whether this boid flocks with another one, or flees it, from their
+     * species (see Flock::Relation).
+     */
+    bool flocksWith(const Boid &other) const;
+    bool flees(const Boid &other) const;
 
     /** 
      * Flying rules
@@ -28,10 +55,52 @@ public:
     void separation(float radius, float weight);
     void fear(float radius, float weight);
 
+    /**
+     * All four rules from a single traversal of the neighbors. Only reads
+     * the flock and returns the steered velocity. The rules are those of
+     * the species of the boid, looked up when not given.
+     */
+    Vector flocking();
+    Vector flocking(const Rules &rules);
+
+    /**
+     * Apply the flying rules to the velocity, without moving.
+     */
+    void steer();
+    void steer(const Rules &rules);
+
+    /**
+     * Move along the current velocity, honoring the flock's limits.
+     */
+    void move();
+
     void update();
 
     /**
      * Getters
      */
-    int inSight(std::function<const void(Boid &boid)> callback, float radius);
-};
\ No newline at end of file
+    int inSight(std::function<void(Boid &boid)> callback, float radius);
+    unsigned inSight(std::vector<unsigned> &neighbors, float radius);
+    unsigned inSight(std::vector<unsigned> &neighbors, float radius,
+                     const Rules &rules);
+
+    /**
+     * Visit the neighbors in sight, passed by reference. The visitor is a
+     * template parameter so the per-neighbor work can be inlined.
+     */
+    template <typename Visitor>
+    int inSight(Visitor &&visit, float radius)
+    {
+        // Shared by the nested calls a visitor may make, each one only
+        // using the indices it appended
+        thread_local std::vector<unsigned> neighbors;
+        unsigned first = neighbors.size();
+        unsigned count = inSight(neighbors, radius);
+        for (unsigned k = first; k < first + count; k++) {
+            Boid other(*flock, neighbors[k]);
+            visit(other);
+        }
+        neighbors.resize(first);
+        return count;
+    }
+};
@@ -3,45 +3,348 @@
  */
 #include "flock.hpp"
 #include "boid.hpp"
-#include "kd-tree.hpp"
+#include "spatial-index.hpp"
 
+#include <algorithm>
 
-Flock::Flock(unsigned size) { init(size); }
+Flock::Flock(unsigned size, SpatialIndex::Type indexType, uint64_t seed)
+    : index(SpatialIndex::create(indexType)),
+      speciesStart(2, 0),
+      relations(1, Relation::Flock),
+      rng(seed)
+{
+    init(size);
+}
 
 void Flock::init(unsigned size)
 {
-    boids.clear();
-    for (unsigned i = 0; i < size; i++) boids.push_back(Boid(*this));
+    state.clear();
+    flags.clear();
+    kinds.clear();
+    history.reset(0, tailLength);
+    std::fill(speciesStart.begin(), speciesStart.end(), 0);
+    resize(size);
+    prepare();
+}
+
+int Flock::addSpecies(const Species &parameters)
+{
+    unsigned n = speciesCount();
+    if (n == maxSpecies) return -1;
+
+    std::vector<Relation> grown((n + 1) * (n + 1), Relation::Ignore);
+    for (unsigned a = 0; a < n; a++)
+        for (unsigned b = 0; b < n; b++)
+            grown[a * (n + 1) + b] = relations[a * n + b];
+    grown[n * (n + 1) + n] = Relation::Flock;
+    relations.swap(grown);
+
+    otherSpecies.push_back(parameters);
+    speciesStart.push_back(state.size());
+    prepare();
+    return n;
+}
+
+Species &Flock::species(unsigned id)
+{
+    return id == 0 ? *this : otherSpecies[id - 1];
+}
+
+const Species &Flock::species(unsigned id) const
+{
+    return id == 0 ? *this : otherSpecies[id - 1];
+}
+
+void Flock::setRelation(unsigned a, unsigned b, Relation relation)
+{
+    if (a >= speciesCount() || b >= speciesCount()) return;
+    relations[a * speciesCount() + b] = relation;
+    prepare();
+}
+
+Flock::Relation Flock::relation(unsigned a, unsigned b) const
+{
+    if (a >= speciesCount() || b >= speciesCount()) return Relation::Ignore;
+    return relations[a * speciesCount() + b];
 }
 
-void Flock::resize(unsigned size)
+/**
+ * New boids are spawned at the end of the arrays then rotated into the
+ * range of their species, past those of the other species.
+ */
+void Flock::resize(unsigned size, unsigned species)
 {
-    while (boids.size() > size) boids.pop_back();
-    while (boids.size() < size) boids.push_back(Boid(*this));
+    if (species >= speciesCount()) return;
+    unsigned first = speciesStart[species], last = speciesStart[species + 1];
+    if (size < last - first) {
+        unsigned removed = last - first - size;
+        for (auto *component : {&state.x, &state.y, &state.vx, &state.vy})
+            component->erase(component->begin() + first + size,
+                             component->begin() + last);
+        flags.erase(flags.begin() + first + size, flags.begin() + last);
+        kinds.erase(kinds.begin() + first + size, kinds.begin() + last);
+        history.erase(first + size, last);
+        for (unsigned s = species + 1; s < speciesStart.size(); s++)
+            speciesStart[s] -= removed;
+        prepare();
+        return;
+    }
+
+    // Stream i spawns the boid that ends up at index i, so the threads
+    // can share the work
+    unsigned end = state.size(), added = size - (last - first);
+    if (added == 0) return;
+    for (auto *component : {&state.x, &state.y, &state.vx, &state.vy})
+        component->resize(end + added);
+    flags.resize(end + added, 0);
+    kinds.resize(end + added, species);
+
+    auto spawn = [&](unsigned begin, unsigned stop) {
+        for (unsigned k = begin; k < stop; k++) {
+            Random::Stream random = rng.stream(last + k);
+            Vector position = Vector::random(random);
+            Vector velocity = spawnVelocity(random, species);
+            state.x[end + k] = position.x;
+            state.y[end + k] = position.y;
+            state.vx[end + k] = velocity.x;
+            state.vy[end + k] = velocity.y;
+        }
+    };
+    if (pool)
+        pool->parallelFor(added, spawn);
+    else
+        spawn(0, added);
+
+    for (unsigned i = end; i < end + added; i++)
+        history.add(Vector(state.x[i], state.y[i]));
+
+    if (last < end) {
+        for (auto *component : {&state.x, &state.y, &state.vx, &state.vy})
+            std::rotate(component->begin() + last, component->begin() + end,
+                        component->end());
+        std::rotate(flags.begin() + last, flags.begin() + end, flags.end());
+        std::rotate(kinds.begin() + last, kinds.begin() + end, kinds.end());
+        history.rotate(last, end, end + added);
+    }
+    for (unsigned s = species + 1; s < speciesStart.size(); s++)
+        speciesStart[s] += added;
+    prepare();
 }
 
-void Flock::each(std::function<const void(Boid &boid)> callback)
+/**
+ * Velocity of a new boid, drawn after its position.
+ */
+Vector Flock::spawnVelocity(Random::Stream &random, unsigned species) const
 {
-    for (auto &boid : boids) callback(boid);
+    double limit = this->species(species).maxVelocity;
+    return Vector::random(random, limit * 2.0, -limit);
+}
+
+/**
+ * The rules of every species for this step, with their relations as bit
+ * masks over the species. A single species flocking with itself flocks
+ * with everyone, so its kernels skip the species of the neighbors.
+ */
+void Flock::prepare()
+{
+    unsigned n = speciesCount();
+    rules.resize(n);
+    for (unsigned s = 0; s < n; s++) {
+        const Species &p = species(s);
+        Boid::Rules &r = rules[s];
+        r.species = &p;
+
+        // Squared in single precision, as the separate rules do
+        float cohesionRadius = p.cohesionRadius;
+        float separationRadius = p.separationRadius;
+        float alignmentRadius = p.alignmentRadius;
+        float fearRadius = p.fearRadius;
+        r.radii.cohesion2 = cohesionRadius * cohesionRadius;
+        r.radii.separation2 = separationRadius * separationRadius;
+        r.radii.alignment2 = alignmentRadius * alignmentRadius;
+        r.radii.fear2 = fearRadius * fearRadius;
+
+        // Weights per reference step, over a step of timeStep of them
+        r.cohesion = float(p.cohesion * timeStep);
+        r.separation = float(p.separation * timeStep);
+        r.alignment = float(p.alignment * timeStep);
+        r.fear = float(p.fear * timeStep);
+        r.fieldOfViewCosine = std::cos(p.fieldOfView / 2);
+        r.maxRadius = p.maxRadius();
+        r.maxVelocity = p.maxVelocity;
+
+        kernels::Interactions &with = r.interactions;
+        with = kernels::Interactions();
+        with.flags = flags.data();
+        with.predator = Predator;
+        if (n > 1 || relation(0, 0) != Relation::Flock) {
+            with.species = kinds.data();
+            with.flock = with.flee = 0;
+            for (unsigned t = 0; t < n; t++) {
+                if (relation(s, t) == Relation::Flock)
+                    with.flock |= uint64_t(1) << t;
+                if (relation(s, t) == Relation::Flee)
+                    with.flee |= uint64_t(1) << t;
+            }
+        }
+    }
 }
 
+/**
+ * Move the boids [begin, end) of state, each species at its own speed
+ * limit.
+ */
+void Flock::integrate(Kinematics &state, unsigned begin, unsigned end)
+{
+    for (unsigned s = 0; s < speciesCount(); s++) {
+        unsigned first = std::max(begin, speciesBegin(s));
+        unsigned last = std::min(end, speciesEnd(s));
+        if (first < last)
+            Mobile::update(state, first, last, rules[s].maxVelocity, wrap,
+                           timeStep);
+    }
+}
+
+void Flock::each(std::function<void(Boid &boid)> callback)
+{
+    each<std::function<void(Boid &boid)> &>(callback);
+}
+
+/**
+ * Advance the flock by one step. The spatial index is rebuilt from the
+ * current positions, then every boid steers before any of them moves so
+ * the index stays valid during the queries.
+ */
 void Flock::compute()
 {
-    
-    for (auto &boid : boids) tree.insert(boid);
+    {
+        ScopedTimer timer(profiler, "index");
+        if (!bruteForce) {
+            index->setRefit(refitThreshold);
+            index->build(state, maxRadius(), wrap);
+        }
+
+        // Queried at the radius of the boids, rounded as they round it
+        batchRadius = 0;
+        if (batchQueries && threads() == 1 && !bruteForce &&
+            !topological && (!wrap || index->periodic())) {
+            batchRadius = static_cast<float>(maxRadius());
+            index->searchAll(batchRadius, batchOffsets, batchNeighbors);
+        }
+    }
+    prepare();
 
-    for (auto &boid : boids) {
-        boid.update(;
+    if ((doubleBuffer || threads() > 1) && fused) {
+        ScopedTimer timer(profiler, "steer");
+        computeDoubleBuffered();
+    } else {
+        {
+            ScopedTimer timer(profiler, "steer");
+            for (unsigned s = 0; s < speciesCount(); s++)
+                for (unsigned i = speciesBegin(s); i < speciesEnd(s); i++)
+                    Boid(*this, i).steer(rules[s]);
+        }
+        ScopedTimer timer(profiler, "integrate");
+        integrate(state, 0, state.size());
     }
+
+    // Record previous positions
+    if (history.length() != static_cast<unsigned>(std::max(tailLength, 0)))
+        history.reset(state.size(), std::max(tailLength, 0));
+    history.record(state);
+    steps++;
+}
+
+/**
+ * Each thread steers a range of boids from the front buffer and writes
+ * them, already moved, to the back buffer. Nothing is written where
+ * others read so the threads never synchronize until the swap.
+ */
+void Flock::computeDoubleBuffered()
+{
+    unsigned n = state.size();
+    next.x.resize(n);
+    next.y.resize(n);
+    next.vx.resize(n);
+    next.vy.resize(n);
+
+    auto steer = [&](unsigned begin, unsigned end) {
+        for (unsigned s = 0; s < speciesCount(); s++) {
+            const Boid::Rules &species = rules[s];
+            unsigned first = std::max(begin, speciesBegin(s));
+            unsigned last = std::min(end, speciesEnd(s));
+            for (unsigned i = first; i < last; i++) {
+                Vector velocity = Boid(*this, i).flocking(species);
+                next.x[i] = state.x[i];
+                next.y[i] = state.y[i];
+                next.vx[i] = velocity.x;
+                next.vy[i] = velocity.y;
+            }
+        }
+        integrate(next, begin, end);
+    };
+
+    if (pool)
+        pool->parallelFor(n, steer);
+    else
+        steer(0, n);
+
+    std::swap(state, next);
+}
+
+void Flock::setThreads(unsigned threads)
+{
+    if (threads > 1)
+        pool.reset(new ThreadPool(threads));
+    else
+        pool.reset();
 }
 
 void Flock::add() {
-    boids.push_back(Boid(*this));
+    resize(speciesEnd(0) - speciesBegin(0) + 1);
 }
 
 void  Flock::add(double x, double y) {
-    boids.push_back(Boid(*this, x, y));
+    add(Vector(x, y));
+}
+
+void Flock::add(const Vector &position, bool isPredator, unsigned species)
+{
+    if (species >= speciesCount()) return;
+    resize(speciesEnd(species) - speciesBegin(species) + 1, species);
+
+    // Where it was asked for, with the velocity of its stream
+    unsigned i = speciesEnd(species) - 1;
+    Random::Stream random = rng.stream(i);
+    random.seek(2);
+    Mobile boid(state, i);
+    boid.setPosition(position);
+    boid.setVelocity(spawnVelocity(random, species));
+    flags[i] = isPredator ? Predator : 0;
+    history.restart(i, position);
 }
 
-unsigned Flock::size() { return boids.size(); }
+unsigned Flock::size() { return state.size(); }
 
+Flock::Statistics Flock::statistics() const
+{
+    Statistics stats;
+    stats.queries = queries;
+    stats.candidates = candidates;
+    stats.neighbors = neighbors;
+    stats.index = index->refitStatistics();
+    return stats;
+}
+
+void Flock::resetStatistics()
+{
+    queries = candidates = neighbors = 0;
+}
+
+double Flock::maxRadius() const
+{
+    double radius = Species::maxRadius();
+    for (auto &other : otherSpecies)
+        radius = std::max(radius, other.maxRadius());
+    return radius;
+}
@@ -3,86 +3,274 @@
  */
 #pragma once
 
+#include <atomic>
+#include <cstdint>
 #include <functional>
+#include <memory>
 #include <vector>
 #include <cmath>
 
 #include "boid.hpp"
-#include "kd-tree.hpp"
+#include "kernels.hpp"
+#include "profiler.hpp"
+#include "random.hpp"
+#include "spatial-index.hpp"
+#include "species.hpp"
+#include "threadpool.hpp"
+#include "trails.hpp"
 
-template <>
-struct Position<Boid> {
-    static float getX(Boid const &p) { return p.position.x; }
-    static float getY(Boid const &p) { return p.position.y; }
-};
-
-class Flock
+/**
+ * Boids of one or more species. The flock's own parameters (inherited
+ * from Species) are those of species 0, the only one unless more are
+ * added.
+ */
+class Flock : public Species
 {
    public:
     /**
-     * Each boid flies towards the the other boids. But they don't just
-     * immediately fly directly at each other. They gradually steer towards
-     * each other at a rate that you can adjust with the "cohesion" slider.
+     * How the boids would behave at the boundaries.
      */
-    double cohesion = 0.05;
-    double cohesionRadius = 0.075;
+    bool wrap = false;
 
     /**
-     * Each boid also tries to avoid running into the other boids. If it
-     * gets too close to another boid it will steer away from it. You can
-     * control how quickly it steers with the "separation" slider.
+     * Find the neighbors by scanning the whole flock instead of querying
+     * the spatial index. Quadratic, only useful to compare results and
+     * timings.
      */
-    double separation = 0.05;
-    double separationRadius = 0.025;
+    bool bruteForce = false;
 
     /**
-     * Eventually, each boid tries to match the vector (speed and direction)
-     * of the other boids around it. Again, you can control how quickly
-     * they try to match vectors using the "alignment" slider.
+     * Evaluate the four rules in a single pass over the neighbors rather
+     * than one neighborhood query per rule.
      */
-    double alignment = 0.05;
-    double alignmentRadius = 0.050;
+    bool fused = true;
 
     /**
-     * Fear
+     * Steer every boid from the state of the previous step (front buffer)
+     * into a back buffer swapped at the end of the step, so the result
+     * does not depend on the update order. Always on with several
+     * threads; requires the fused rules.
      */
-    double fear = 0.05;
-    double fearRadius = 0.075;
+    bool doubleBuffer = false;
 
     /**
-     * Angle of vision of each boid. A 360° range meant the boid can see
-     * anywhere around itself.
+     * Topological interaction, as observed in starlings: when non-zero,
+     * each boid only considers this many nearest boids (then those in
+     * sight), however dense the flock. The radii of the rules still bound
+     * the neighborhoods; make them large for a purely topological flock.
      */
-    double fieldOfView = 210 * (2.0 * (atan(1.0) * 4.0) / 360.0);
+    unsigned topological = 0;
 
     /**
-     * Maximum speed for boids in this very universe.
+     * Search the neighborhoods of all the boids in one pass over the
+     * index when it is built, rather than once per boid while steering.
+     * The batch runs on one thread, before the steering is shared, so it
+     * is skipped with several threads.
      */
-    double maxVelocity = 0.001;
+    bool batchQueries = true;
 
     /**
-     * How the boids would behave at the boundaries.
+     * Refit the spatial index to the new positions of the boids rather
+     * than build it again, when it can, rebuilding only the parts that
+     * became too loose (see ImplicitKDTree::refit). Negative always
+     * builds.
      */
-    bool wrap = false;
+    double refitThreshold = -1;
+
+    /**
+     * Length of a step, in steps at the reference rate the velocities,
+     * speed limits and weights of the rules are tuned for: a step of 2
+     * moves and steers the boids as much as two reference steps, up to
+     * the discretization. Simulation sets it from its rate.
+     */
+    double timeStep = 1;
 
     int tailLength = 20;
 
-    Flock(unsigned numBoids = 100);
+    /**
+     * Count the neighborhood queries (see statistics()).
+     */
+    bool countQueries = false;
+
+    /**
+     * Time the phases of compute() (index, steer, integrate) when set.
+     * Batched queries are part of the index phase.
+     * With double buffering steering and integration are one phase,
+     * recorded as steer.
+     */
+    Profiler *profiler = nullptr;
+
+    struct Statistics {
+        unsigned long queries = 0;     // Neighborhood queries
+        unsigned long candidates = 0;  // Boids returned by the index
+        unsigned long neighbors = 0;   // Boids actually in sight
+        RefitStatistics index;         // Updates of the spatial index
+    };
+
+    /**
+     * Per-boid flags.
+     */
+    enum Flags : uint8_t { Predator = 1 };
+
+    /**
+     * How the boids of a species treat those of another one in sight:
+     * not at all, as their own flock (cohesion, separation and
+     * alignment), or as predators to flee. Predator boids are fled
+     * whatever their species.
+     */
+    enum class Relation : uint8_t { Ignore, Flock, Flee };
+
+    /**
+     * The relations are bit masks over the species.
+     */
+    static const unsigned maxSpecies = 64;
+
+    /**
+     * @param seed Seed of every random number of the flock, the same seed
+     *             giving the same flock
+     */
+    Flock(unsigned numBoids = 100,
+          SpatialIndex::Type indexType = SpatialIndex::Type::KDTree,
+          uint64_t seed = 1);
 
     void compute();
 
+    /**
+     * Number of threads sharing the steering and integration.
+     */
+    void setThreads(unsigned threads);
+    unsigned threads() const { return pool ? pool->size() : 1; }
+
+    /**
+     * Add a species with its parameters, flocking with itself and
+     * ignoring the others (and ignored by them). Returns its id, or -1
+     * when there are already maxSpecies.
+     */
+    int addSpecies(const Species &parameters);
+
+    unsigned speciesCount() const { return speciesStart.size() - 1; }
+
+    /**
+     * Parameters of a species, this flock's own for species 0.
+     */
+    Species &species(unsigned id);
+    const Species &species(unsigned id) const;
+
+    /**
+     * How the boids of species a treat those of species b. Unknown
+     * species are ignored.
+     */
+    void setRelation(unsigned a, unsigned b, Relation relation);
+    Relation relation(unsigned a, unsigned b) const;
+
+    /**
+     * Boids are stored by species, those of a species being the range
+     * [speciesBegin(id), speciesEnd(id)) of kinematics(), so each species
+     * is steered and integrated as a whole. Adding or removing boids
+     * moves those of the next species.
+     */
+    unsigned speciesBegin(unsigned id) const { return speciesStart[id]; }
+    unsigned speciesEnd(unsigned id) const { return speciesStart[id + 1]; }
+    unsigned speciesOf(unsigned boid) const { return kinds[boid]; }
+
+    /**
+     * Boids are spawned from a random stream of their index, in parallel
+     * when there are threads, with the same result. Without a species,
+     * they are of species 0; none is added to an unknown species.
+     */
     void add();
     void add(double x, double y);
-    void resize(unsigned size);
+    void add(const Vector &position, bool isPredator = false,
+             unsigned species = 0);
 
-    void each(std::function<const void(Boid &boid)> callback);
+    /**
+     * Spawn or remove boids of a species to have size of them. Unknown
+     * species are ignored.
+     */
+    void resize(unsigned size, unsigned species = 0);
+
+    /**
+     * Random numbers of a boid for the current step, for stochastic
+     * rules. Reproducible from the seed whatever the thread drawing them.
+     */
+    Random::Stream random(unsigned boid) const
+    {
+        return rng.stream(boid, steps + 1);
+    }
+
+    void each(std::function<void(Boid &boid)> callback);
+
+    /**
+     * Same as above with the visitor as a template parameter, so the
+     * calls can be inlined.
+     */
+    template <typename Visitor>
+    void each(Visitor &&visit)
+    {
+        for (unsigned i = 0; i < state.size(); i++) {
+            Boid boid(*this, i);
+            visit(boid);
+        }
+    }
 
     unsigned size();
 
+    /**
+     * Raw positions and velocities of the boids.
+     */
+    const Kinematics &kinematics() const { return state; }
+
+    /**
+     * Previous positions of the boids, tailLength per boid.
+     */
+    const Trails &trails() const { return history; }
+
+    Statistics statistics() const;
+    void resetStatistics();
+
+    /**
+     * Largest radius any of the rules of any species looks at.
+     */
+    double maxRadius() const;
+
    private:
+    friend class Boid;
+
+    std::unique_ptr<SpatialIndex> index;
+
+    /**
+     * Boids are stored as a structure of arrays, Boid being only a handle
+     * on one index of these arrays.
+     */
+    Kinematics state;
+    Kinematics next;  // Back buffer when double buffering
+    std::vector<uint8_t> flags;
+    std::vector<uint8_t> kinds;  // Species of each boid
+    Trails history;
+
+    std::vector<Species> otherSpecies;   // 1 and up
+    std::vector<unsigned> speciesStart;  // First boid of each, then size
+    std::vector<Relation> relations;     // [a][b], speciesCount() wide
+
+    // Of each species, prepared once per step by compute() and whenever
+    // the species, their relations or the boids change
+    std::vector<Boid::Rules> rules;
+
+    // Candidates of every boid found by compute() within batchRadius,
+    // zero when not batched (see SpatialIndex::searchAll)
+    float batchRadius = 0;
+    std::vector<unsigned> batchOffsets, batchNeighbors;
+
+    std::unique_ptr<ThreadPool> pool;
+
+    Random rng;
+    unsigned long steps = 0;  // Computed so far
 
-    KDTree<Boid> kdtree;
-    std::vector<Boid> boids;
+    std::atomic<unsigned long> queries{0}, candidates{0}, neighbors{0};
 
     void init(unsigned size);
+    Vector spawnVelocity(Random::Stream &random, unsigned species) const;
+    void prepare();
+    void integrate(Kinematics &state, unsigned begin, unsigned end);
+    void computeDoubleBuffered();
 };
@@ -0,0 +1,127 @@
+/**
+ * Uniform grid (cell list) over the unit square.
+ */
+#include "grid.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+/**
+ * Cell along an axis. The mobiles may stray a little past the edges: in
+ * the wrapped space they belong to the cell of their image inside the
+ * square, otherwise to the edge cell.
+ */
+int GridIndex::cell(double coordinate) const
+{
+    int c = static_cast<int>(std::floor(coordinate * cells));
+    if (wrap) return (c % cells + cells) % cells;
+    return std::min(std::max(c, 0), cells - 1);
+}
+
+/**
+ * Bucket the mobiles with a counting sort: the cells are sized to the
+ * largest radius so a query only looks at the neighboring cells.
+ */
+void GridIndex::build(Kinematics &state, double radius, bool wrap)
+{
+    this->wrap = wrap;
+    cells = radius > 0 ? std::max(1, static_cast<int>(1.0 / radius)) : 1;
+    cellSize = 1.0 / cells;
+
+    cellStart.assign(cells * cells + 1, 0);
+    cellOf.resize(state.size());
+    for (unsigned i = 0; i < state.size(); i++) {
+        cellOf[i] = cell(state.y[i]) * cells + cell(state.x[i]);
+        cellStart[cellOf[i] + 1]++;
+    }
+
+    for (int c = 0; c < cells * cells; c++) cellStart[c + 1] += cellStart[c];
+
+    std::vector<unsigned> next(cellStart.begin(), cellStart.end() - 1);
+    items.resize(state.size());
+    points.resize(state.size());
+    for (unsigned i = 0; i < state.size(); i++) {
+        unsigned slot = next[cellOf[i]]++;
+        items[slot] = i;
+        points[slot] = Vector(state.x[i], state.y[i]);
+    }
+}
+
+/**
+ * Call visit(mobile, squared distance) for the mobiles closer than the
+ * radius.
+ */
+template <typename Visitor>
+void GridIndex::visit(const Vector &position, double radius,
+                      Visitor &&visit) const
+{
+    int span = static_cast<int>(std::ceil(radius / cellSize));
+    int cx = cell(position.x), cy = cell(position.y);
+    double r2 = radius * radius;
+
+    // Visit each cell once even when the span covers the whole row
+    int first = -span, last = span;
+    if (wrap && 2 * span + 1 >= cells) first = 0, last = cells - 1;
+
+    for (int dy = first; dy <= last; dy++) {
+        int y = wrap && first == 0 ? dy : cy + dy;
+        if (wrap) y = (y % cells + cells) % cells;
+        else if (y < 0 || y >= cells) continue;
+
+        for (int dx = first; dx <= last; dx++) {
+            int x = wrap && first == 0 ? dx : cx + dx;
+            if (wrap) x = (x % cells + cells) % cells;
+            else if (x < 0 || x >= cells) continue;
+
+            int c = y * cells + x;
+            for (unsigned i = cellStart[c]; i < cellStart[c + 1]; i++) {
+                double d2 = wrap ? position.toroidal_distance2(points[i])
+                                 : (position - points[i]).norm2();
+                if (d2 < r2) visit(items[i], d2);
+            }
+        }
+    }
+}
+
+void GridIndex::search(const Vector &position, double radius,
+                       std::vector<unsigned> &neighbors)
+{
+    visit(position, radius,
+          [&](unsigned i, double) { neighbors.push_back(i); });
+}
+
+/**
+ * The mobiles within the radius, then the k nearest of them. The radius
+ * bounds the cells visited, not the size of the selection.
+ */
+void GridIndex::nearest(const Vector &position, unsigned k, double radius,
+                        std::vector<unsigned> &neighbors)
+{
+    thread_local std::vector<std::pair<double, unsigned>> candidates;
+    candidates.clear();
+    visit(position, radius,
+          [&](unsigned i, double d2) { candidates.emplace_back(d2, i); });
+    keepNearest(candidates, k, neighbors);
+}
+
+/**
+ * The cells already group the queries by neighborhood, so each mobile is
+ * simply searched in turn.
+ */
+void GridIndex::searchAll(double radius, std::vector<unsigned> &offsets,
+                          std::vector<unsigned> &neighbors)
+{
+    slotOf.resize(items.size());
+    for (unsigned slot = 0; slot < items.size(); slot++)
+        slotOf[items[slot]] = slot;
+
+    offsets.resize(items.size() + 1);
+    neighbors.clear();
+    for (unsigned i = 0; i < items.size(); i++) {
+        offsets[i] = neighbors.size();
+        visit(points[slotOf[i]], radius, [&](unsigned j, double) {
+            if (j != i) neighbors.push_back(j);
+        });
+    }
+    offsets[items.size()] = neighbors.size();
+}
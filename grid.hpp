@@ -0,0 +1,36 @@
+/**
+ * Uniform grid (cell list) over the unit square.
+ */
+#pragma once
+
+#include <vector>
+
+#include "spatial-index.hpp"
+
+class GridIndex : public SpatialIndex
+{
+    int cells = 1;  // Number of cells along each axis
+    double cellSize = 1.0;
+    bool wrap = false;
+
+    std::vector<unsigned> cellStart;  // First item of each cell (CSR)
+    std::vector<unsigned> cellOf;     // Cell of each mobile
+    std::vector<unsigned> items;      // Mobiles sorted by cell
+    std::vector<Vector> points;       // Their positions, same order
+    std::vector<unsigned> slotOf;     // Item of each mobile, by searchAll()
+
+    int cell(double coordinate) const;
+
+    template <typename Visitor>
+    void visit(const Vector &position, double radius, Visitor &&visit) const;
+
+   public:
+    void build(Kinematics &state, double radius, bool wrap) override;
+    void search(const Vector &position, double radius,
+                std::vector<unsigned> &neighbors) override;
+    void nearest(const Vector &position, unsigned k, double radius,
+                 std::vector<unsigned> &neighbors) override;
+    void searchAll(double radius, std::vector<unsigned> &offsets,
+                   std::vector<unsigned> &neighbors) override;
+    bool periodic() const override { return true; }
+};
@@ -0,0 +1,406 @@
+/**
+ * KD-tree laid out as flat arrays, without node pointers.
+ */
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "kd-tree.hpp"
+
+/**
+ * Work done by the updates of an ImplicitKDTree, to tune the refit
+ * threshold.
+ */
+struct RefitStatistics {
+    unsigned long builds = 0;    // Full builds
+    unsigned long refits = 0;    // Refits of the whole tree
+    unsigned long rebuilds = 0;  // Subtrees rebuilt during the refits
+    unsigned long rebuilt = 0;   // Elements of these subtrees
+};
+
+/**
+ * Same queries as KDTree over a complete binary tree stored in breadth
+ * first order: the children of node i are 2i and 2i + 1, the root is 1
+ * and the nodes past the last split are the leaves. Each leaf is a bucket
+ * of a few elements, contiguous in the element arrays, whose range
+ * follows from the median splits so it is not stored either.
+ *
+ * The axes alternate with the depth as in KDTree, so a split is only its
+ * two bounds, in single precision: 8 bytes per node, the splits of 100k
+ * elements fit in 64 KB. The coordinates are copied next to the elements
+ * so a leaf is scanned without going through T.
+ */
+template <typename T>
+class ImplicitKDTree
+{
+    struct Split {
+        float low;   // Largest coordinate on the left, rounded up
+        float high;  // Smallest coordinate on the right, rounded down
+    };
+
+    std::vector<Split> splits;  // splits[0] unused
+    std::vector<T> items;       // In leaf order
+    std::vector<real> xs, ys;   // Coordinates of the items
+    size_t leaves = 1;
+
+    // Bounding box of the elements
+    double minX = 0, minY = 0, maxX = 0, maxY = 0;
+
+    RefitStatistics stats;
+
+    struct Box {
+        double minX, minY, maxX, maxY;
+    };
+    std::vector<Box> boxes;  // Of the subtrees during a refit
+
+    static double coordinate(const T &element, int depth)
+    {
+        return depth % 2 == 0 ? Position<T>::getX(element)
+                              : Position<T>::getY(element);
+    }
+
+    static float roundUp(double value)
+    {
+        float f = static_cast<float>(value);
+        return f < value ? std::nextafter(f, std::numeric_limits<float>::max())
+                         : f;
+    }
+
+    static float roundDown(double value)
+    {
+        float f = static_cast<float>(value);
+        return f > value
+                   ? std::nextafter(f, std::numeric_limits<float>::lowest())
+                   : f;
+    }
+
+    /**
+     * Median split of items[begin, end) along the axis of the depth. The
+     * bounds rather than the median let the queries skip the gap between
+     * the halves.
+     */
+    void buildNode(size_t node, size_t begin, size_t end, int depth)
+    {
+        if (node >= leaves) return;
+
+        size_t mid = begin + (end - begin) / 2;
+        auto less = [depth](const T &a, const T &b) {
+            return coordinate(a, depth) < coordinate(b, depth);
+        };
+        std::nth_element(items.begin() + begin, items.begin() + mid,
+                         items.begin() + end, less);
+
+        double low = -std::numeric_limits<double>::infinity();
+        double high = std::numeric_limits<double>::infinity();
+        for (size_t i = begin; i < mid; i++)
+            low = std::max(low, coordinate(items[i], depth));
+        if (mid < end) high = coordinate(items[mid], depth);
+        splits[node] = {roundUp(low), roundDown(high)};
+
+        buildNode(2 * node, begin, mid, depth + 1);
+        buildNode(2 * node + 1, mid, end, depth + 1);
+    }
+
+    /**
+     * Copy the coordinates of items[begin, end) next to them and return
+     * their bounding box.
+     */
+    Box load(size_t begin, size_t end)
+    {
+        double inf = std::numeric_limits<double>::infinity();
+        Box box = {inf, inf, -inf, -inf};
+        for (size_t i = begin; i < end; i++) {
+            xs[i] = Position<T>::getX(items[i]);
+            ys[i] = Position<T>::getY(items[i]);
+            box.minX = std::min<double>(box.minX, xs[i]);
+            box.minY = std::min<double>(box.minY, ys[i]);
+            box.maxX = std::max<double>(box.maxX, xs[i]);
+            box.maxY = std::max<double>(box.maxY, ys[i]);
+        }
+        return box;
+    }
+
+    /**
+     * Bounding boxes of the subtrees at the new positions, bottom-up.
+     */
+    Box fitNode(size_t node, size_t begin, size_t end)
+    {
+        if (node >= leaves) return boxes[node] = load(begin, end);
+
+        size_t mid = begin + (end - begin) / 2;
+        Box left = fitNode(2 * node, begin, mid);
+        Box right = fitNode(2 * node + 1, mid, end);
+        return boxes[node] = {std::min(left.minX, right.minX),
+                              std::min(left.minY, right.minY),
+                              std::max(left.maxX, right.maxX),
+                              std::max(left.maxY, right.maxY)};
+    }
+
+    /**
+     * Bounds of the splits from the boxes, top-down. The halves of a node
+     * may now overlap, which only costs the searches some pruning; past
+     * threshold times the extent of the node, the node is split again
+     * and its subtree with it. Each node keeps its elements, so this
+     * rebuild stays within the subtree.
+     */
+    void refitNode(size_t node, size_t begin, size_t end, int depth,
+                   double threshold)
+    {
+        if (node >= leaves) return;
+
+        const Box &left = boxes[2 * node], &right = boxes[2 * node + 1];
+        const Box &box = boxes[node];
+        bool x = depth % 2 == 0;
+        double low = x ? left.maxX : left.maxY;
+        double high = x ? right.minX : right.minY;
+        double extent = x ? box.maxX - box.minX : box.maxY - box.minY;
+        if (low - high > threshold * extent) {
+            buildNode(node, begin, end, depth);
+            load(begin, end);
+            stats.rebuilds++;
+            stats.rebuilt += end - begin;
+            return;
+        }
+
+        splits[node] = {roundUp(low), roundDown(high)};
+        size_t mid = begin + (end - begin) / 2;
+        refitNode(2 * node, begin, mid, depth + 1, threshold);
+        refitNode(2 * node + 1, mid, end, depth + 1, threshold);
+    }
+
+    template <typename Visitor>
+    void searchNode(size_t node, size_t begin, size_t end, int depth,
+                    double x, double y, double r, Visitor &visit)
+    {
+        if (node >= leaves) {
+            double r2 = r * r;
+            for (size_t i = begin; i < end; i++) {
+                double dx = x - xs[i], dy = y - ys[i];
+                double dist = dx * dx + dy * dy;
+                if (dist < r2) visit(items[i], dist);
+            }
+            return;
+        }
+
+        size_t mid = begin + (end - begin) / 2;
+        const Split &split = splits[node];
+        double q = depth % 2 == 0 ? x : y;
+        if (q - r <= split.low)
+            searchNode(2 * node, begin, mid, depth + 1, x, y, r, visit);
+        if (q + r >= split.high)
+            searchNode(2 * node + 1, mid, end, depth + 1, x, y, r, visit);
+    }
+
+    void setBounds(const Box &box)
+    {
+        if (items.empty()) return;
+        minX = box.minX, minY = box.minY;
+        maxX = box.maxX, maxY = box.maxY;
+    }
+
+    static bool closer(const std::pair<double, T> &a,
+                       const std::pair<double, T> &b)
+    {
+        return a.first < b.first;
+    }
+
+    /**
+     * Best bin first as in KDTree, the nearer half first and the other
+     * one only if it may hold something closer than the k-th found.
+     */
+    void nearestNode(size_t node, size_t begin, size_t end, int depth,
+                     double x, double y, unsigned k, double &worst,
+                     std::vector<std::pair<double, T>> &heap)
+    {
+        if (node >= leaves) {
+            for (size_t i = begin; i < end; i++) {
+                double dx = x - xs[i], dy = y - ys[i];
+                double dist = dx * dx + dy * dy;
+                if (dist >= worst) continue;
+                heap.emplace_back(dist, items[i]);
+                std::push_heap(heap.begin(), heap.end(), closer);
+                if (heap.size() > k) {
+                    std::pop_heap(heap.begin(), heap.end(), closer);
+                    heap.pop_back();
+                }
+                if (heap.size() == k) worst = heap.front().first;
+            }
+            return;
+        }
+
+        size_t mid = begin + (end - begin) / 2;
+        const Split &split = splits[node];
+        double q = depth % 2 == 0 ? x : y;
+        double left = std::max(0.0, q - split.low);
+        double right = std::max(0.0, split.high - q);
+        if (left <= right) {
+            nearestNode(2 * node, begin, mid, depth + 1, x, y, k, worst, heap);
+            if (right * right < worst)
+                nearestNode(2 * node + 1, mid, end, depth + 1, x, y, k, worst,
+                            heap);
+        } else {
+            nearestNode(2 * node + 1, mid, end, depth + 1, x, y, k, worst,
+                        heap);
+            if (left * left < worst)
+                nearestNode(2 * node, begin, mid, depth + 1, x, y, k, worst,
+                            heap);
+        }
+    }
+
+   public:
+    /**
+     * Most elements per leaf, the leaves hold from about bucket / 2 to
+     * bucket elements.
+     */
+    static const size_t bucket = 16;
+
+    ImplicitKDTree() = default;
+    ImplicitKDTree(const ImplicitKDTree &) = delete;
+    ImplicitKDTree &operator=(const ImplicitKDTree &) = delete;
+
+    /**
+     * Replace the content of the tree with the elements in [first, last),
+     * in O(N log N). The arrays are reused from one build to the next.
+     */
+    template <typename Iterator>
+    void build(Iterator first, Iterator last)
+    {
+        items.assign(first, last);
+        leaves = 1;
+        while (leaves * bucket < items.size()) leaves *= 2;
+        splits.resize(leaves);
+        buildNode(1, 0, items.size(), 0);
+
+        xs.resize(items.size());
+        ys.resize(items.size());
+        setBounds(load(0, items.size()));
+        stats.builds++;
+    }
+
+    /**
+     * Follow the elements to their new positions, keeping the shape of
+     * the tree: much cheaper than a build when they moved little. Nodes
+     * whose halves overlap by more than threshold times their extent
+     * along the split are rebuilt, so 0 rebuilds any overlapping node.
+     * The elements must be the same as at the last build.
+     */
+    void refit(double threshold)
+    {
+        boxes.resize(2 * leaves);
+        setBounds(fitNode(1, 0, items.size()));
+        refitNode(1, 0, items.size(), 0, threshold);
+        stats.refits++;
+    }
+
+    const RefitStatistics &statistics() const { return stats; }
+
+    void clear()
+    {
+        items.clear();
+        xs.clear();
+        ys.clear();
+        splits.clear();
+        boxes.clear();
+        leaves = 1;
+    }
+
+    size_t size() const { return items.size(); }
+
+    /**
+     * Append the elements closer than r from (x, y) to ids.
+     */
+    void search(double x, double y, double r, std::vector<T> &ids)
+    {
+        search(x, y, r, [&](const T &element, double) {
+            ids.push_back(element);
+        });
+    }
+
+    /**
+     * Call visit(element, squared distance) for each element closer than
+     * r from (x, y).
+     */
+    template <typename Visitor>
+    void search(double x, double y, double r, Visitor &&visit)
+    {
+        searchNode(1, 0, items.size(), 0, x, y, r, visit);
+    }
+
+    /**
+     * Search in the periodic domain [0, width) x [0, height), as
+     * KDTree::search does.
+     */
+    template <typename Visitor>
+    void search(double x, double y, double r, double width, double height,
+                Visitor &&visit)
+    {
+        double dxs[] = {0, width, -width}, dys[] = {0, height, -height};
+        bool inX[] = {true, x + width - r < maxX, x - width + r > minX};
+        bool inY[] = {true, y + height - r < maxY, y - height + r > minY};
+
+        for (int i = 0; i < 3; i++)
+            for (int j = 0; j < 3; j++)
+                if (inX[i] && inY[j])
+                    search(x + dxs[i], y + dys[j], r, visit);
+    }
+
+    /**
+     * The k elements nearest to (x, y) and closer than r, by increasing
+     * distance, with their squared distances.
+     */
+    void nearest(double x, double y, unsigned k, double r,
+                 std::vector<std::pair<double, T>> &found)
+    {
+        found.clear();
+        double worst = r * r;
+        if (k > 0)
+            nearestNode(1, 0, items.size(), 0, x, y, k, worst, found);
+        std::sort_heap(found.begin(), found.end(), closer);
+    }
+
+    /**
+     * Same in the periodic domain [0, width) x [0, height), as
+     * KDTree::nearest does.
+     */
+    void nearest(double x, double y, unsigned k, double r, double width,
+                 double height, std::vector<std::pair<double, T>> &found)
+    {
+        found.clear();
+        double worst = r * r;
+        if (k > 0) {
+            for (double ox : {0.0, width, -width}) {
+                for (double oy : {0.0, height, -height}) {
+                    double qx = x + ox, qy = y + oy;
+                    double gx = std::max({0.0, minX - qx, qx - maxX});
+                    double gy = std::max({0.0, minY - qy, qy - maxY});
+                    if (gx * gx + gy * gy < worst)
+                        nearestNode(1, 0, items.size(), 0, qx, qy, k, worst,
+                                    found);
+                }
+            }
+        }
+        std::sort_heap(found.begin(), found.end(), closer);
+    }
+
+    /**
+     * Call func(element) for every element, leaf after leaf, so nearby
+     * elements come one after the other.
+     */
+    template <typename Visitor>
+    void traverse(Visitor &&func)
+    {
+        for (const T &element : items) func(element);
+    }
+
+    std::vector<Vector> traverse()
+    {
+        std::vector<Vector> points;
+        for (size_t i = 0; i < items.size(); i++)
+            points.emplace_back(xs[i], ys[i]);
+        return points;
+    }
+};
@@ -1,9 +1,17 @@
 #pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
 #include <functional>
 #include <iostream>
+#include <limits>
 #include <stack>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
+#include "vector.hpp"
+
 template <class Geometry>
 struct Position;
 
@@ -13,170 +21,627 @@ struct Position;
 //     static float getY(Vector const &p) { return p.y; }
 // };
 
+/**
+ * Element of a tree built over an external array: the index of the
+ * element in the array and a copy of its coordinates, so the tree never
+ * reads the array again.
+ */
+struct IndexedPoint {
+    real x, y;
+    uint32_t index;
+
+    bool operator==(const IndexedPoint &other) const
+    {
+        return index == other.index;
+    }
+};
+
+template <>
+struct Position<IndexedPoint> {
+    static real getX(IndexedPoint const &p) { return p.x; }
+    static real getY(IndexedPoint const &p) { return p.y; }
+};
+
+/**
+ * Node of a KDTree, linked to its children by their index in the tree's
+ * arena. The splitting axis alternates with the depth, so it is not
+ * stored either.
+ */
 template <typename T>
 struct Node {
+    static constexpr uint32_t none = UINT32_MAX;
+
     T element;
-    Node<T> *left, *right;
-    int dim;
-    Node(T element, int dim = 0)
-        : element(element), left(nullptr), right(nullptr), dim(dim)
-    {
-    }
+    uint32_t left = none, right = none;
+
+    Node(T element) : element(element) {}
 
-    double getX() { return Position<T>::getX(element); }
-    double getY() { return Position<T>::getY(element); }
+    double getX() const { return Position<T>::getX(element); }
+    double getY() const { return Position<T>::getY(element); }
 };
 
 template <typename T>
 class KDTree
 {
-    Node<T> *root;
-    void insertNode(Node<T> *node, T element)
-    {
-        double x = Position<T>::getX(element);
-        double y = Position<T>::getY(element);
+    static constexpr uint32_t none = Node<T>::none;
 
-        if (node == nullptr) {
-            root = new Node<T>(element);
-            return;
+    uint32_t root = none;
+    std::vector<Node<T>> nodes;  // Arena
+
+    // Bounding box of the elements
+    double minX = 0, minY = 0, maxX = 0, maxY = 0;
+
+    /**
+     * Box of a subtree, in single precision rounded outward: it only
+     * dismisses subtrees, which it still never does wrongly.
+     */
+    struct Box {
+        float minX, minY, maxX, maxY;
+
+        static Box around(double x, double y)
+        {
+            return {roundDown(x), roundDown(y), roundUp(x), roundUp(y)};
         }
 
-        if (node->element == element) {
-            return;
+        void extend(const Box &other)
+        {
+            minX = std::min(minX, other.minX);
+            minY = std::min(minY, other.minY);
+            maxX = std::max(maxX, other.maxX);
+            maxY = std::max(maxY, other.maxY);
         }
+    };
+    std::vector<Box> boxes;  // Of each subtree, same order as the arena
 
-        bool comp = node->dim % 2 == 0 ? x < node->getX() : y < node->getY();
-        Node<T> **indirect = comp ? &node->left : &node->right;
-        if (*indirect == nullptr) {
-            *indirect = new Node<T>(element, node->dim + 1);
-            return;
+    static float roundUp(double value)
+    {
+        float f = static_cast<float>(value);
+        return f < value ? std::nextafter(f, std::numeric_limits<float>::max())
+                         : f;
+    }
+
+    static float roundDown(double value)
+    {
+        float f = static_cast<float>(value);
+        return f > value
+                   ? std::nextafter(f, std::numeric_limits<float>::lowest())
+                   : f;
+    }
+
+    Node<T> *at(uint32_t node) { return node == none ? nullptr : &nodes[node]; }
+
+    void extend(const T &element)
+    {
+        double x = Position<T>::getX(element), y = Position<T>::getY(element);
+        if (nodes.empty()) {
+            minX = maxX = x;
+            minY = maxY = y;
         }
-        insertNode(*indirect, element);
+        minX = std::min(minX, x);
+        maxX = std::max(maxX, x);
+        minY = std::min(minY, y);
+        maxY = std::max(maxY, y);
     }
 
-    void searchNode(Node<T> *node, T element, double r, std::vector<T> &ids)
+    void insertNode(uint32_t node, const T &element, int depth)
     {
         double x = Position<T>::getX(element);
         double y = Position<T>::getY(element);
 
-        if (node == nullptr) {
+        if (nodes[node].element == element) {
+            return;
+        }
+        boxes[node].extend(Box::around(x, y));
+
+        bool comp = depth % 2 == 0 ? x < nodes[node].getX()
+                                   : y < nodes[node].getY();
+        uint32_t child = comp ? nodes[node].left : nodes[node].right;
+        if (child == none) {
+            child = allocate(element);
+            (comp ? nodes[node].left : nodes[node].right) = child;
+            return;
+        }
+        insertNode(child, element, depth + 1);
+    }
+
+    template <typename Visitor>
+    void searchNode(uint32_t i, double x, double y, double r, Visitor &visit,
+                    int depth)
+    {
+        if (i == none) {
             return;
         }
+        const Node<T> &node = nodes[i];
 
-        if (node->dim % 2 == 0 ? x - r < node->getX() : y - r < node->getY()) 
-            searchNode(node->left, element, r, ids);
+        if (depth % 2 == 0 ? x - r < node.getX() : y - r < node.getY()) 
+            searchNode(node.left, x, y, r, visit, depth + 1);
         
-        if (node->dim % 2 == 0 ? x + r > node->getX() : y + r > node->getY()) 
-            searchNode(node->right, element, r, ids);
+        if (depth % 2 == 0 ? x + r > node.getX() : y + r > node.getY()) 
+            searchNode(node.right, x, y, r, visit, depth + 1);
         
-        double dist = (x - node->getX()) * (x - node->getX()) +
-                      (y - node->getY()) * (y - node->getY());
+        double dist = (x - node.getX()) * (x - node.getX()) +
+                      (y - node.getY()) * (y - node.getY());
 
-        if (dist < r * r) 
-            ids.push_back(node->element);
-        
+        if (dist < r * r) visit(node.element, dist);
     }
-    void removeNode(Node<T> *node, int id)
+
+    static bool closer(const std::pair<double, T> &a,
+                       const std::pair<double, T> &b)
     {
-        if (node == nullptr) {
-            return;
-        }
+        return a.first < b.first;
+    }
 
-        if (node->id == id) {
-            if (node->left == nullptr && node->right == nullptr) {
-                delete node;
-                return;
-            }
-            if (node->left == nullptr) {
-                Node<T> *temp = node->right;
-                delete node;
-                node = temp;
-                return;
-            }
-            if (node->right == nullptr) {
-                Node<T> *temp = node->left;
-                delete node;
-                node = temp;
-                return;
-            }
-            Node<T> *temp = node->right;
-            while (temp->left != nullptr) {
-                temp = temp->left;
+    /**
+     * Best bin first: the side of the split holding the query is searched
+     * before the other one, which is skipped when the splitting line is
+     * farther than the k-th nearest found so far. heap is a max-heap on
+     * the distance, holding at most k elements.
+     */
+    void nearestNode(uint32_t i, double x, double y, unsigned k,
+                     double &worst, std::vector<std::pair<double, T>> &heap,
+                     int depth)
+    {
+        if (i == none) return;
+        const Node<T> &node = nodes[i];
+
+        double dx = x - node.getX(), dy = y - node.getY();
+        double dist = dx * dx + dy * dy;
+        if (dist < worst) {
+            heap.emplace_back(dist, node.element);
+            std::push_heap(heap.begin(), heap.end(), closer);
+            if (heap.size() > k) {
+                std::pop_heap(heap.begin(), heap.end(), closer);
+                heap.pop_back();
             }
-            node->id = temp->id;
-            removeNode(node->right, temp->id);
-            return;
+            if (heap.size() == k) worst = heap.front().first;
         }
-        removeNode(node->getX() < id ? node->right : node->left, id);
+
+        double split = depth % 2 == 0 ? dx : dy;
+        nearestNode(split < 0 ? node.left : node.right, x, y, k, worst, heap,
+                    depth + 1);
+        if (split * split < worst)
+            nearestNode(split < 0 ? node.right : node.left, x, y, k, worst,
+                        heap, depth + 1);
     }
 
-    void clearNode(Node<T> *node)
+    /**
+     * Distances in the plane.
+     */
+    struct Planar {
+        double distance2(double dx, double dy) const
+        {
+            return dx * dx + dy * dy;
+        }
+
+        static double gap(double lo1, double hi1, double lo2, double hi2)
+        {
+            return std::max({0.0, lo1 - hi2, lo2 - hi1});
+        }
+
+        double distance2(const Box &a, const Box &b) const
+        {
+            double gx = gap(a.minX, a.maxX, b.minX, b.maxX);
+            double gy = gap(a.minY, a.maxY, b.minY, b.maxY);
+            return gx * gx + gy * gy;
+        }
+
+        double distance2(double x, double y, const Box &b) const
+        {
+            double gx = gap(x, x, b.minX, b.maxX);
+            double gy = gap(y, y, b.minY, b.maxY);
+            return gx * gx + gy * gy;
+        }
+    };
+
+    /**
+     * Distances on the torus [0, width) x [0, height), to the nearest
+     * image, computed as the flock's kernels do.
+     */
+    struct Periodic {
+        double width, height;
+
+        double distance2(double dx, double dy) const
+        {
+            double ax = std::fabs(dx), ay = std::fabs(dy);
+            ax = ax > width / 2 ? width - ax : ax;
+            ay = ay > height / 2 ? height - ay : ay;
+            return ax * ax + ay * ay;
+        }
+
+        static double gap(double lo1, double hi1, double lo2, double hi2,
+                          double period)
+        {
+            return std::min(
+                {Planar::gap(lo1, hi1, lo2, hi2),
+                 Planar::gap(lo1, hi1, lo2 + period, hi2 + period),
+                 Planar::gap(lo1, hi1, lo2 - period, hi2 - period)});
+        }
+
+        double distance2(const Box &a, const Box &b) const
+        {
+            double gx = gap(a.minX, a.maxX, b.minX, b.maxX, width);
+            double gy = gap(a.minY, a.maxY, b.minY, b.maxY, height);
+            return gx * gx + gy * gy;
+        }
+
+        double distance2(double x, double y, const Box &b) const
+        {
+            double gx = gap(x, x, b.minX, b.maxX, width);
+            double gy = gap(y, y, b.minY, b.maxY, height);
+            return gx * gx + gy * gy;
+        }
+    };
+
+    /**
+     * Pairs of the element of p with the subtree of node.
+     */
+    template <typename Metric, typename Visitor>
+    void joinPoint(uint32_t p, uint32_t node, const Metric &metric, double r2,
+                   Visitor &visit)
+    {
+        if (node == none) return;
+        const Node<T> &a = nodes[p], &b = nodes[node];
+        if (metric.distance2(a.getX(), a.getY(), boxes[node]) > r2) return;
+
+        double dist = metric.distance2(a.getX() - b.getX(),
+                                       a.getY() - b.getY());
+        if (dist < r2) visit(a.element, b.element, dist);
+        joinPoint(p, b.left, metric, r2, visit);
+        joinPoint(p, b.right, metric, r2, visit);
+    }
+
+    /**
+     * Pairs across two disjoint subtrees. The one with the larger box is
+     * split, so both sides shrink together and far apart pairs of
+     * subtrees are dismissed at once.
+     */
+    template <typename Metric, typename Visitor>
+    void joinSubtrees(uint32_t a, uint32_t b, const Metric &metric,
+                      double r2, Visitor &visit)
+    {
+        if (a == none || b == none) return;
+        if (metric.distance2(boxes[a], boxes[b]) > r2) return;
+
+        const Box &ba = boxes[a], &bb = boxes[b];
+        if ((ba.maxX - ba.minX) + (ba.maxY - ba.minY) <
+            (bb.maxX - bb.minX) + (bb.maxY - bb.minY))
+            std::swap(a, b);
+
+        joinPoint(a, b, metric, r2, visit);
+        joinSubtrees(nodes[a].left, b, metric, r2, visit);
+        joinSubtrees(nodes[a].right, b, metric, r2, visit);
+    }
+
+    /**
+     * Pairs within a subtree: its element with both children, each child
+     * with itself, then the children with each other.
+     */
+    template <typename Metric, typename Visitor>
+    void join(uint32_t node, const Metric &metric, double r2, Visitor &visit)
     {
-        if (node == nullptr) return;
+        if (node == none) return;
+        uint32_t left = nodes[node].left, right = nodes[node].right;
+        joinPoint(node, left, metric, r2, visit);
+        joinPoint(node, right, metric, r2, visit);
+        join(left, metric, r2, visit);
+        join(right, metric, r2, visit);
+        joinSubtrees(left, right, metric, r2, visit);
     }
 
-    void traverseNode(Node<T> *node, std::function<void(Node<T> *)> func)
+    /**
+     * Nodes live in a single arena reused from one build to the next,
+     * linked by index so growing it moves nothing else.
+     */
+    uint32_t allocate(const T &element)
     {
-        if (node == nullptr) {
+        extend(element);
+        double x = Position<T>::getX(element), y = Position<T>::getY(element);
+        boxes.push_back(Box::around(x, y));
+        nodes.emplace_back(element);
+        return nodes.size() - 1;
+    }
+
+    /**
+     * Balanced build in place of the nodes [begin, end): the median along
+     * the splitting axis stays in the middle as the root of the range,
+     * the halves on each side are its subtrees.
+     */
+    uint32_t buildNode(uint32_t begin, uint32_t end, int depth)
+    {
+        if (begin == end) return none;
+
+        uint32_t mid = begin + (end - begin) / 2;
+        std::nth_element(
+            nodes.begin() + begin, nodes.begin() + mid, nodes.begin() + end,
+            [depth](const Node<T> &a, const Node<T> &b) {
+                return depth % 2 == 0 ? a.getX() < b.getX()
+                                      : a.getY() < b.getY();
+            });
+
+        uint32_t left = buildNode(begin, mid, depth + 1);
+        uint32_t right = buildNode(mid + 1, end, depth + 1);
+        Node<T> &node = nodes[mid];
+        node.left = left;
+        node.right = right;
+        boxes[mid] = Box::around(node.getX(), node.getY());
+        if (left != none) boxes[mid].extend(boxes[left]);
+        if (right != none) boxes[mid].extend(boxes[right]);
+        return mid;
+    }
+
+    /**
+     * The elements were placed in the arena, link them into a tree.
+     */
+    void link()
+    {
+        boxes.resize(nodes.size());
+        root = buildNode(0, nodes.size(), 0);
+    }
+
+    template <typename Visitor>
+    void traverseNode(uint32_t node, Visitor &func)
+    {
+        if (node == none) {
             return;
         }
-        func(node);
-        if (node->left != nullptr) {
-            traverseNode(node->left, func);
-        }
-        if (node->right != nullptr) {
-            traverseNode(node->right, func);
-        }
+        func(&nodes[node]);
+        traverseNode(nodes[node].left, func);
+        traverseNode(nodes[node].right, func);
     }
 
-    void print(const std::string &prefix, const Node<T> *node, bool isLeft)
+    void print(const std::string &prefix, uint32_t node, bool isLeft)
     {
-        if (node == nullptr) return;
-        std::cout << prefix << (isLeft ? "├◐─" : "└◑─") << node->element
+        if (node == none) return;
+        std::cout << prefix << (isLeft ? "├◐─" : "└◑─") << nodes[node].element
                   << std::endl;
-        print(prefix + (isLeft ? "│   " : "    "), node->left, true);
-        print(prefix + (isLeft ? "│   " : "    "), node->right, false);
+        print(prefix + (isLeft ? "│   " : "    "), nodes[node].left, true);
+        print(prefix + (isLeft ? "│   " : "    "), nodes[node].right, false);
     }
 
    public:
-    KDTree() : root(nullptr) {}
-    void remove(int id) { removeNode(root, id); }
+    KDTree() = default;
+    KDTree(const KDTree &) = delete;
+    KDTree &operator=(const KDTree &) = delete;
 
     void print() { print("", root, false); }
 
     void insert(T element)
     {
-        if (root == nullptr) {
-            root = new Node<T>(element);
+        if (root == none) {
+            root = allocate(element);
             return;
         }
-        insertNode(root, element);
+        insertNode(root, element, 0);
+    }
+
+    /**
+     * Replace the content of the tree with a balanced tree of the
+     * elements in [first, last), in O(N log N).
+     */
+    template <typename Iterator>
+    void build(Iterator first, Iterator last)
+    {
+        clear();
+        for (; first != last; ++first) {
+            extend(*first);
+            nodes.emplace_back(*first);
+        }
+        link();
+    }
+    /**
+     * Index the elements of an external array, of a type with a Position,
+     * the tree holding their indices (see IndexedPoint).
+     */
+    template <typename Element>
+    void build(const Element *elements, uint32_t count)
+    {
+        static_assert(std::is_same<T, IndexedPoint>::value,
+                      "only trees of IndexedPoint index an array");
+        clear();
+        nodes.reserve(count);
+        for (uint32_t i = 0; i < count; i++) {
+            IndexedPoint point = {Position<Element>::getX(elements[i]),
+                                  Position<Element>::getY(elements[i]), i};
+            extend(point);
+            nodes.emplace_back(point);
+        }
+        link();
     }
+
+    /**
+     * Same with the coordinates as two arrays.
+     */
+    void build(const real *x, const real *y, uint32_t count)
+    {
+        static_assert(std::is_same<T, IndexedPoint>::value,
+                      "only trees of IndexedPoint index an array");
+        clear();
+        nodes.reserve(count);
+        for (uint32_t i = 0; i < count; i++) {
+            IndexedPoint point = {x[i], y[i], i};
+            extend(point);
+            nodes.emplace_back(point);
+        }
+        link();
+    }
+
+    /**
+     * Write the indices of the elements closer than r from (x, y) to out,
+     * at most capacity of them, and return how many there are: when more
+     * than capacity, out holds the first ones and the query is to be
+     * repeated with a larger buffer. Never allocates.
+     */
+    size_t search(double x, double y, double r, uint32_t *out,
+                  size_t capacity)
+    {
+        size_t count = 0;
+        search(x, y, r, [&](const IndexedPoint &point, double) {
+            if (count < capacity) out[count] = point.index;
+            count++;
+        });
+        return count;
+    }
+
+    /**
+     * Same in the periodic domain [0, width) x [0, height).
+     */
+    size_t search(double x, double y, double r, double width, double height,
+                  uint32_t *out, size_t capacity)
+    {
+        size_t count = 0;
+        search(x, y, r, width, height, [&](const IndexedPoint &point, double) {
+            if (count < capacity) out[count] = point.index;
+            count++;
+        });
+        return count;
+    }
+
     std::vector<T> search(T element, double r)
     {
         std::vector<T> ids;
-        searchNode(root, element, r, ids);
+        search(Position<T>::getX(element), Position<T>::getY(element), r, ids);
         return ids;
     }
-    void clear() { clearNode(root); }
+
+    /**
+     * Append the elements closer than r from (x, y) to ids.
+     */
+    void search(double x, double y, double r, std::vector<T> &ids)
+    {
+        search(x, y, r, [&](const T &element, double) { ids.push_back(element); });
+    }
+
+    /**
+     * Call visit(element, squared distance) for each element closer than
+     * r from (x, y). The visitor is a template parameter so the calls can
+     * be inlined.
+     */
+    template <typename Visitor>
+    void search(double x, double y, double r, Visitor &&visit)
+    {
+        searchNode(root, x, y, r, visit, 0);
+    }
+
+    /**
+     * Search in the periodic domain [0, width) x [0, height) (a torus).
+     * The images of the query disc that cross an edge are searched as
+     * well, so the squared distances, when requested, are those to the
+     * nearest image. The radius must be less than half the domain.
+     */
+    void search(double x, double y, double r, double width, double height,
+                std::vector<T> &ids, std::vector<double> *distances2 = nullptr)
+    {
+        search(x, y, r, width, height, [&](const T &element, double dist) {
+            ids.push_back(element);
+            if (distances2) distances2->push_back(dist);
+        });
+    }
+
+    template <typename Visitor>
+    void search(double x, double y, double r, double width, double height,
+                Visitor &&visit)
+    {
+        // Against the bounding box rather than the domain, the elements may
+        // stray a little outside
+        double dxs[] = {0, width, -width}, dys[] = {0, height, -height};
+        bool xs[] = {true, x + width - r < maxX, x - width + r > minX};
+        bool ys[] = {true, y + height - r < maxY, y - height + r > minY};
+
+        for (int i = 0; i < 3; i++)
+            for (int j = 0; j < 3; j++)
+                if (xs[i] && ys[j])
+                    searchNode(root, x + dxs[i], y + dys[j], r, visit, 0);
+    }
+
+    /**
+     * Call visit(a, b, squared distance) once for every pair of elements
+     * closer than r, in one traversal of the tree against itself rather
+     * than one search per element: nearby elements share the node visits
+     * and distant subtrees are dismissed pairwise.
+     */
+    template <typename Visitor>
+    void searchPairs(double r, Visitor &&visit)
+    {
+        join(root, Planar(), r * r, visit);
+    }
+
+    /**
+     * Same in the periodic domain [0, width) x [0, height).
+     */
+    template <typename Visitor>
+    void searchPairs(double r, double width, double height, Visitor &&visit)
+    {
+        join(root, Periodic{width, height}, r * r, visit);
+    }
+
+    /**
+     * The k elements nearest to (x, y) and closer than r, by increasing
+     * distance, with their squared distances. found is only cleared, so
+     * reusing it across queries avoids allocating.
+     */
+    void nearest(double x, double y, unsigned k, double r,
+                 std::vector<std::pair<double, T>> &found)
+    {
+        found.clear();
+        double worst = r * r;
+        if (k > 0) nearestNode(root, x, y, k, worst, found, 0);
+        std::sort_heap(found.begin(), found.end(), closer);
+    }
+
+    /**
+     * Same in the periodic domain [0, width) x [0, height). The images of
+     * the query are searched in turn, those farther from the elements'
+     * bounding box than the k-th nearest found so far are skipped. The
+     * radius must be less than half the domain.
+     */
+    void nearest(double x, double y, unsigned k, double r, double width,
+                 double height, std::vector<std::pair<double, T>> &found)
+    {
+        found.clear();
+        double worst = r * r;
+        if (k > 0) {
+            for (double ox : {0.0, width, -width}) {
+                for (double oy : {0.0, height, -height}) {
+                    double qx = x + ox, qy = y + oy;
+                    double gx = std::max({0.0, minX - qx, qx - maxX});
+                    double gy = std::max({0.0, minY - qy, qy - maxY});
+                    if (gx * gx + gy * gy < worst)
+                        nearestNode(root, qx, qy, k, worst, found, 0);
+                }
+            }
+        }
+        std::sort_heap(found.begin(), found.end(), closer);
+    }
+
+    /**
+     * Empty the tree, keeping the arena for the next build.
+     */
+    void clear()
+    {
+        nodes.clear();
+        boxes.clear();
+        root = none;
+    }
+
+    size_t size() const { return nodes.size(); }
 
     std::vector<Vector> traverse()
     {
         std::vector<Vector> points;
-        if (root == nullptr) {
+        if (root == none) {
             return points;
         }
-        std::vector<Node<T> *> nodes;
-        nodes.push_back(root);
-        while (nodes.size() > 0) {
-            Node<T> *node = nodes.back();
-            nodes.pop_back();
-            points.push_back(node->element);
-            if (node->left != nullptr) {
-                nodes.push_back(node->left);
+        std::vector<uint32_t> stack;
+        stack.push_back(root);
+        while (stack.size() > 0) {
+            const Node<T> &node = nodes[stack.back()];
+            stack.pop_back();
+            points.push_back(node.element);
+            if (node.left != none) {
+                stack.push_back(node.left);
             }
-            if (node->right != nullptr) {
-                nodes.push_back(node->right);
+            if (node.right != none) {
+                stack.push_back(node.right);
             }
         }
         return points;
@@ -187,19 +652,32 @@ class KDTree
         traverseNode(root, func);
     }
 
-    class iterator : public std::iterator<std::input_iterator_tag, Node<T> >
+    template <typename Visitor>
+    void traverse(Visitor &&func)
+    {
+        traverseNode(root, func);
+    }
+
+    class iterator
     {
        public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+        using pointer = T *;
+        using reference = T &;
+
+        KDTree *tree;
         Node<T> *node;
         std::stack<Node<T> *> stack;
 
-        iterator(Node<T> *node) : node(node)
+        iterator(KDTree *tree, Node<T> *node) : tree(tree), node(node)
         {
             auto root = node;
 
             if (root != nullptr) {
                 stack.push(node);
-                root = root->left;
+                root = tree->left(root);
             }
 
             if (stack.size() > 0) {
@@ -211,10 +689,10 @@ class KDTree
         }
         iterator &operator++()
         {
-            if (node->right) {
-                stack.push(node->right);
+            if (Node<T> *right = tree->right(node)) {
+                stack.push(right);
 
-                if (node->right->left) stack.push(node->right->left);
+                if (Node<T> *left = tree->left(right)) stack.push(left);
             }
 
             if (stack.size() == 0) {
@@ -231,8 +709,14 @@ class KDTree
         T operator*() { return node->element; }
     };
 
-    iterator begin() { return iterator(root); }
-    iterator end() { return iterator(nullptr); }
+    iterator begin() { return iterator(this, at(root)); }
+    iterator end() { return iterator(this, nullptr); }
 
-    Node<T> *getRoot() { return root; }
+    /**
+     * The root and the children of a node, null where there are none.
+     * The splitting axis of a node is x at even depths, y at odd ones.
+     */
+    Node<T> *getRoot() { return at(root); }
+    Node<T> *left(const Node<T> *node) { return at(node->left); }
+    Node<T> *right(const Node<T> *node) { return at(node->right); }
 };
@@ -13,8 +13,8 @@ struct Bounds {
     double xmin, xmax, ymin, ymax;
 };
 
-void drawTree(Node<Vector> *node, Bounds bounds, sf::RenderWindow &window,
-              sf::VertexArray &lines)
+void drawTree(KDTree<Vector> &kd, Node<Vector> *node, int depth,
+              Bounds bounds, sf::RenderWindow &window, sf::VertexArray &lines)
 {
     if (node == NULL) {
         return;
@@ -34,7 +34,7 @@ void drawTree(Node<Vector> *node, Bounds bounds, sf::RenderWindow &window,
     // window.draw(text);
 
     sf::Vertex a, b;
-    if (node->dim % 2 == 0) {
+    if (depth % 2 == 0) {
         a.position = sf::Vector2f(node->getX(), bounds.ymin);
         b.position = sf::Vector2f(node->getX(), bounds.ymax);
         a.color = b.color = sf::Color(200, 50, 30, 100);
@@ -48,20 +48,20 @@ void drawTree(Node<Vector> *node, Bounds bounds, sf::RenderWindow &window,
 
     {
         auto b = bounds;
-        if (node->dim % 2 == 0)
+        if (depth % 2 == 0)
             b.xmax = node->getX();
         else
             b.ymax = node->getY();
-        drawTree(node->left, b, window, lines);
+        drawTree(kd, kd.left(node), depth + 1, b, window, lines);
     }
     {
         auto b = bounds;
-        if (node->dim % 2 == 0)
+        if (depth % 2 == 0)
             b.xmin = node->getX();
         else
             b.ymin = node->getY();
 
-        drawTree(node->right, b, window, lines);
+        drawTree(kd, kd.right(node), depth + 1, b, window, lines);
     }
 }
 
@@ -70,7 +70,7 @@ void drawTree(KDTree<Vector> &kd, sf::RenderWindow &window)
     Bounds bounds(
         {0, (double)window.getSize().x, 0, (double)window.getSize().y});
     sf::VertexArray lines(sf::Lines);
-    drawTree(kd.getRoot(), bounds, window, lines);
+    drawTree(kd, kd.getRoot(), 0, bounds, window, lines);
     window.draw(lines);
 }
 
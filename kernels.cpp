@@ -0,0 +1,494 @@
+/**
+ * Inner loops of the simulation, in a scalar version and vectorized
+ * versions selected at runtime from the CPU features.
+ */
+#include "kernels.hpp"
+
+#include <cmath>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define KERNELS_X86
+#include <immintrin.h>
+#endif
+
+namespace kernels {
+
+static Isa selected = detect();
+
+Isa detect()
+{
+#ifdef KERNELS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return Isa::AVX2;
+#endif
+    return Isa::Scalar;
+}
+
+Isa current() { return selected; }
+
+void select(Isa isa) { selected = isa <= detect() ? isa : detect(); }
+
+const char *name(Isa isa)
+{
+    switch (isa) {
+        case Isa::AVX2:
+            return "avx2";
+        case Isa::Scalar:
+        default:
+            return "scalar";
+    }
+}
+
+/**
+ * Reference implementations, in the same order of operations as the
+ * separate rules of Boid.
+ */
+static void accumulateScalar(const Kinematics &s, const Interactions &with,
+                             const unsigned *neighbors, unsigned n, real x,
+                             real y, const Radii &r, bool wrap,
+                             Neighborhood &out)
+{
+    for (unsigned k = 0; k < n; k++) {
+        unsigned i = neighbors[k];
+        real dx = x - s.x[i], dy = y - s.y[i];
+        if (wrap) {  // Offsets to the nearest image of the neighbor
+            dx = dx > real(0.5) ? dx - 1 : dx < real(-0.5) ? dx + 1 : dx;
+            dy = dy > real(0.5) ? dy - 1 : dy < real(-0.5) ? dy + 1 : dy;
+        }
+        real d2 = dx * dx + dy * dy;
+        real ox = wrap ? x - dx : s.x[i], oy = wrap ? y - dy : s.y[i];
+
+        bool flocks = true, flees = with.flags[i] & with.predator;
+        if (with.species) {
+            uint64_t bit = uint64_t(1) << with.species[i];
+            flocks = with.flock & bit;
+            flees = flees || (with.flee & bit);
+        }
+
+        if (flocks && d2 < r.cohesion2) {
+            out.centerX += ox;
+            out.centerY += oy;
+            out.cohesive++;
+        }
+        if (flocks && d2 < r.separation2) {
+            out.awayX += dx;
+            out.awayY += dy;
+        }
+        if (flocks && d2 < r.alignment2) {
+            out.sumX += s.vx[i];
+            out.sumY += s.vy[i];
+            out.aligned++;
+        }
+        if (d2 < r.fear2 && flees) {
+            out.predatorX += ox;
+            out.predatorY += oy;
+            out.predators++;
+        }
+    }
+}
+
+/**
+ * The angle test without trigonometry, comparing dot / |d| to the cosine
+ * squared so no root is taken either. Beyond half a turn (negative cosine)
+ * everything ahead is visible, and behind only near the sides.
+ */
+static unsigned visibleScalar(const Kinematics &s, const unsigned *candidates,
+                              unsigned n, unsigned self, const Cone &c,
+                              bool wrap, unsigned *out)
+{
+    real c2 = c.cosine * c.cosine;
+    unsigned count = 0;
+    for (unsigned k = 0; k < n; k++) {
+        unsigned i = candidates[k];
+        real dx = s.x[i] - c.x, dy = s.y[i] - c.y;
+        if (wrap) {
+            dx = dx > real(0.5) ? dx - 1 : dx < real(-0.5) ? dx + 1 : dx;
+            dy = dy > real(0.5) ? dy - 1 : dy < real(-0.5) ? dy + 1 : dy;
+        }
+        real d2 = dx * dx + dy * dy;
+        real dot = dx * c.hx + dy * c.hy;
+
+        bool inside = c.cosine >= 0 ? dot > 0 && dot * dot > c2 * d2
+                                    : dot >= 0 || dot * dot < c2 * d2;
+        if (d2 < c.radius2 && inside && i != self) out[count++] = i;
+    }
+    return count;
+}
+
+static void integrateScalar(Kinematics &s, unsigned begin, unsigned end,
+                            real maxVelocity, bool wrapping, real step)
+{
+    for (unsigned i = begin; i < end; i++) {
+        real speed = std::sqrt(s.vx[i] * s.vx[i] + s.vy[i] * s.vy[i]);
+        if (wrapping)
+            Mobile::wrap(s, i);
+        else
+            Mobile::bounce(s, i, speed * 5, speed / 5 * step);
+
+        // Update position
+        speed = std::sqrt(s.vx[i] * s.vx[i] + s.vy[i] * s.vy[i]);
+        if (speed > maxVelocity) {
+            s.vx[i] *= maxVelocity / speed;
+            s.vy[i] *= maxVelocity / speed;
+        }
+        s.x[i] += s.vx[i] * step;
+        s.y[i] += s.vy[i] * step;
+    }
+}
+
+#ifdef KERNELS_X86
+
+#define TARGET_AVX2 __attribute__((target("avx2")))
+
+/**
+ * The AVX2 operations the kernels need, for each scalar type, so the
+ * kernels are written once: 4 lanes in double precision, 8 in single.
+ */
+template <typename T>
+struct Avx2;
+
+template <>
+struct Avx2<double> {
+    using V = __m256d;
+    static constexpr unsigned width = 4;
+
+    TARGET_AVX2 static V set1(double a) { return _mm256_set1_pd(a); }
+    TARGET_AVX2 static V zero() { return _mm256_setzero_pd(); }
+    TARGET_AVX2 static V load(const double *p) { return _mm256_loadu_pd(p); }
+    TARGET_AVX2 static void store(double *p, V a) { _mm256_storeu_pd(p, a); }
+    TARGET_AVX2 static V add(V a, V b) { return _mm256_add_pd(a, b); }
+    TARGET_AVX2 static V sub(V a, V b) { return _mm256_sub_pd(a, b); }
+    TARGET_AVX2 static V mul(V a, V b) { return _mm256_mul_pd(a, b); }
+    TARGET_AVX2 static V div(V a, V b) { return _mm256_div_pd(a, b); }
+    TARGET_AVX2 static V sqrt(V a) { return _mm256_sqrt_pd(a); }
+    TARGET_AVX2 static V lt(V a, V b) { return _mm256_cmp_pd(a, b, _CMP_LT_OQ); }
+    TARGET_AVX2 static V gt(V a, V b) { return _mm256_cmp_pd(a, b, _CMP_GT_OQ); }
+    TARGET_AVX2 static V ge(V a, V b) { return _mm256_cmp_pd(a, b, _CMP_GE_OQ); }
+    TARGET_AVX2 static V bitand_(V a, V b) { return _mm256_and_pd(a, b); }
+    TARGET_AVX2 static V bitor_(V a, V b) { return _mm256_or_pd(a, b); }
+    TARGET_AVX2 static V blend(V a, V b, V mask) { return _mm256_blendv_pd(a, b, mask); }
+    TARGET_AVX2 static int bits(V mask) { return _mm256_movemask_pd(mask); }
+
+    // Mobile::bounce takes float arguments
+    TARGET_AVX2 static V narrow(V a) { return _mm256_cvtps_pd(_mm256_cvtpd_ps(a)); }
+
+    TARGET_AVX2 static double sum(V v)
+    {
+        __m128d half = _mm_add_pd(_mm256_castpd256_pd128(v),
+                                  _mm256_extractf128_pd(v, 1));
+        return _mm_cvtsd_f64(_mm_add_sd(half, _mm_unpackhi_pd(half, half)));
+    }
+
+    /**
+     * Load base[i[0..3]]. Plain loads measured as fast as the gather
+     * instruction, which is microcoded on many CPUs.
+     */
+    TARGET_AVX2 static V gather(const double *base, const unsigned *i)
+    {
+        return _mm256_set_pd(base[i[3]], base[i[2]], base[i[1]], base[i[0]]);
+    }
+
+    /**
+     * Lane mask from the low bits of an integer.
+     */
+    TARGET_AVX2 static V mask(int bits)
+    {
+        __m256i lanes = _mm256_set_epi64x(8, 4, 2, 1);
+        __m256i set = _mm256_and_si256(_mm256_set1_epi64x(bits), lanes);
+        return _mm256_castsi256_pd(_mm256_cmpeq_epi64(set, lanes));
+    }
+};
+
+template <>
+struct Avx2<float> {
+    using V = __m256;
+    static constexpr unsigned width = 8;
+
+    TARGET_AVX2 static V set1(float a) { return _mm256_set1_ps(a); }
+    TARGET_AVX2 static V zero() { return _mm256_setzero_ps(); }
+    TARGET_AVX2 static V load(const float *p) { return _mm256_loadu_ps(p); }
+    TARGET_AVX2 static void store(float *p, V a) { _mm256_storeu_ps(p, a); }
+    TARGET_AVX2 static V add(V a, V b) { return _mm256_add_ps(a, b); }
+    TARGET_AVX2 static V sub(V a, V b) { return _mm256_sub_ps(a, b); }
+    TARGET_AVX2 static V mul(V a, V b) { return _mm256_mul_ps(a, b); }
+    TARGET_AVX2 static V div(V a, V b) { return _mm256_div_ps(a, b); }
+    TARGET_AVX2 static V sqrt(V a) { return _mm256_sqrt_ps(a); }
+    TARGET_AVX2 static V lt(V a, V b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+    TARGET_AVX2 static V gt(V a, V b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+    TARGET_AVX2 static V ge(V a, V b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+    TARGET_AVX2 static V bitand_(V a, V b) { return _mm256_and_ps(a, b); }
+    TARGET_AVX2 static V bitor_(V a, V b) { return _mm256_or_ps(a, b); }
+    TARGET_AVX2 static V blend(V a, V b, V mask) { return _mm256_blendv_ps(a, b, mask); }
+    TARGET_AVX2 static int bits(V mask) { return _mm256_movemask_ps(mask); }
+    TARGET_AVX2 static V narrow(V a) { return a; }
+
+    TARGET_AVX2 static float sum(V v)
+    {
+        __m128 quad = _mm_add_ps(_mm256_castps256_ps128(v),
+                                 _mm256_extractf128_ps(v, 1));
+        __m128 pair = _mm_add_ps(quad, _mm_movehl_ps(quad, quad));
+        return _mm_cvtss_f32(_mm_add_ss(pair, _mm_shuffle_ps(pair, pair, 1)));
+    }
+
+    TARGET_AVX2 static V gather(const float *base, const unsigned *i)
+    {
+        return _mm256_set_ps(base[i[7]], base[i[6]], base[i[5]], base[i[4]],
+                             base[i[3]], base[i[2]], base[i[1]], base[i[0]]);
+    }
+
+    TARGET_AVX2 static V mask(int bits)
+    {
+        __m256i lanes = _mm256_set_epi32(128, 64, 32, 16, 8, 4, 2, 1);
+        __m256i set = _mm256_and_si256(_mm256_set1_epi32(bits), lanes);
+        return _mm256_castsi256_ps(_mm256_cmpeq_epi32(set, lanes));
+    }
+};
+
+/**
+ * A vector of neighbors at a time: their coordinates are gathered from
+ * the arrays, each rule's radius test becomes a mask applied to the sums.
+ */
+template <typename T>
+TARGET_AVX2 static void accumulateAVX2(const Kinematics &s,
+                                       const Interactions &with,
+                                       const unsigned *neighbors, unsigned n,
+                                       T x, T y, const Radii &r, bool wrap,
+                                       Neighborhood &out)
+{
+    using S = Avx2<T>;
+    using V = typename S::V;
+
+    const V px = S::set1(x), py = S::set1(y);
+    const V c2 = S::set1(r.cohesion2), s2 = S::set1(r.separation2);
+    const V a2 = S::set1(r.alignment2), f2 = S::set1(r.fear2);
+    const V half = S::set1(0.5), minusHalf = S::set1(-0.5);
+    const V one = S::set1(1);
+
+    V cx = S::zero(), cy = cx, sx = cx, sy = cx;
+    V ax = cx, ay = cx, fx = cx, fy = cx;
+    unsigned cohesive = 0, aligned = 0, predators = 0;
+
+    unsigned k = 0;
+    for (; k + S::width <= n; k += S::width) {
+        const unsigned *idx = neighbors + k;
+        V ox = S::gather(s.x.data(), idx), oy = S::gather(s.y.data(), idx);
+
+        V dx = S::sub(px, ox), dy = S::sub(py, oy);
+        if (wrap) {  // Offsets to, and position of, the nearest image
+            dx = S::blend(dx, S::sub(dx, one), S::gt(dx, half));
+            dx = S::blend(dx, S::add(dx, one), S::lt(dx, minusHalf));
+            dy = S::blend(dy, S::sub(dy, one), S::gt(dy, half));
+            dy = S::blend(dy, S::add(dy, one), S::lt(dy, minusHalf));
+            ox = S::sub(px, dx);
+            oy = S::sub(py, dy);
+        }
+        V d2 = S::add(S::mul(dx, dx), S::mul(dy, dy));
+
+        // Lanes of the species flocked with and fled, when there are
+        // species, predators being fled whatever their species
+        int flocks = 0, flees = 0;
+        if (with.species) {
+            for (unsigned l = 0; l < S::width; l++) {
+                uint64_t bit = uint64_t(1) << with.species[idx[l]];
+                if (with.flock & bit) flocks |= 1 << l;
+                if ((with.flee & bit) || (with.flags[idx[l]] & with.predator))
+                    flees |= 1 << l;
+            }
+            if (!flocks && !flees) continue;
+        }
+        V mc = S::lt(d2, c2), ms = S::lt(d2, s2), ma = S::lt(d2, a2);
+        if (with.species) {
+            V kept = S::mask(flocks);
+            mc = S::bitand_(mc, kept);
+            ms = S::bitand_(ms, kept);
+            ma = S::bitand_(ma, kept);
+        }
+
+        cx = S::add(cx, S::bitand_(mc, ox));
+        cy = S::add(cy, S::bitand_(mc, oy));
+        cohesive += __builtin_popcount(S::bits(mc));
+
+        sx = S::add(sx, S::bitand_(ms, dx));
+        sy = S::add(sy, S::bitand_(ms, dy));
+
+        if (S::bits(ma)) {
+            V ovx = S::gather(s.vx.data(), idx);
+            V ovy = S::gather(s.vy.data(), idx);
+            ax = S::add(ax, S::bitand_(ma, ovx));
+            ay = S::add(ay, S::bitand_(ma, ovy));
+            aligned += __builtin_popcount(S::bits(ma));
+        }
+
+        V mf = S::lt(d2, f2);
+        if (S::bits(mf)) {
+            int bits = flees;
+            for (unsigned l = 0; l < S::width && !with.species; l++)
+                if (with.flags[idx[l]] & with.predator) bits |= 1 << l;
+            mf = S::bitand_(mf, S::mask(bits));
+            fx = S::add(fx, S::bitand_(mf, ox));
+            fy = S::add(fy, S::bitand_(mf, oy));
+            predators += __builtin_popcount(S::bits(mf));
+        }
+    }
+
+    out.centerX += S::sum(cx);
+    out.centerY += S::sum(cy);
+    out.awayX += S::sum(sx);
+    out.awayY += S::sum(sy);
+    out.sumX += S::sum(ax);
+    out.sumY += S::sum(ay);
+    out.predatorX += S::sum(fx);
+    out.predatorY += S::sum(fy);
+    out.cohesive += cohesive;
+    out.aligned += aligned;
+    out.predators += predators;
+
+    // Leave the AVX state clean before running SSE code
+    _mm256_zeroupper();
+    accumulateScalar(s, with, neighbors + k, n - k, x, y, r, wrap, out);
+}
+
+/**
+ * The cone test on a vector of candidates, the lanes that pass being
+ * written out in order.
+ */
+template <typename T>
+TARGET_AVX2 static unsigned visibleAVX2(const Kinematics &s,
+                                        const unsigned *candidates,
+                                        unsigned n, unsigned self,
+                                        const Cone &c, bool wrap,
+                                        unsigned *out)
+{
+    using S = Avx2<T>;
+    using V = typename S::V;
+
+    const V px = S::set1(c.x), py = S::set1(c.y);
+    const V hx = S::set1(c.hx), hy = S::set1(c.hy);
+    const V c2 = S::set1(c.cosine * c.cosine), r2 = S::set1(c.radius2);
+    const V zero = S::zero(), half = S::set1(0.5), one = S::set1(1);
+    const V minusHalf = S::set1(-0.5);
+    const bool narrow = c.cosine >= 0;
+
+    unsigned count = 0;
+    unsigned k = 0;
+    for (; k + S::width <= n; k += S::width) {
+        const unsigned *idx = candidates + k;
+        V dx = S::sub(S::gather(s.x.data(), idx), px);
+        V dy = S::sub(S::gather(s.y.data(), idx), py);
+        if (wrap) {
+            dx = S::blend(dx, S::sub(dx, one), S::gt(dx, half));
+            dx = S::blend(dx, S::add(dx, one), S::lt(dx, minusHalf));
+            dy = S::blend(dy, S::sub(dy, one), S::gt(dy, half));
+            dy = S::blend(dy, S::add(dy, one), S::lt(dy, minusHalf));
+        }
+        V d2 = S::add(S::mul(dx, dx), S::mul(dy, dy));
+        V dot = S::add(S::mul(dx, hx), S::mul(dy, hy));
+        V dot2 = S::mul(dot, dot), limit = S::mul(c2, d2);
+
+        V inside = narrow
+            ? S::bitand_(S::gt(dot, zero), S::gt(dot2, limit))
+            : S::bitor_(S::ge(dot, zero), S::lt(dot2, limit));
+        int bits = S::bits(S::bitand_(inside, S::lt(d2, r2)));
+        while (bits) {
+            unsigned i = idx[__builtin_ctz(bits)];
+            if (i != self) out[count++] = i;
+            bits &= bits - 1;
+        }
+    }
+
+    _mm256_zeroupper();
+    return count + visibleScalar(s, candidates + k, n - k, self, c, wrap,
+                                 out + count);
+}
+
+/**
+ * Same steps as integrateScalar on a vector of mobiles at a time, the
+ * branches becoming blends. The operations are the same so the results
+ * are too.
+ */
+template <typename T>
+TARGET_AVX2 static void integrateAVX2(Kinematics &s, unsigned begin,
+                                      unsigned end, T maxVelocity,
+                                      bool wrapping, T step)
+{
+    using S = Avx2<T>;
+    using V = typename S::V;
+
+    const V zero = S::zero(), one = S::set1(1), five = S::set1(5);
+    const V limit = S::set1(maxVelocity), dt = S::set1(step);
+
+    unsigned i = begin;
+    for (; i + S::width <= end; i += S::width) {
+        V x = S::load(&s.x[i]), y = S::load(&s.y[i]);
+        V vx = S::load(&s.vx[i]), vy = S::load(&s.vy[i]);
+
+        if (wrapping) {
+            x = S::blend(x, S::add(x, one), S::lt(x, zero));
+            y = S::blend(y, S::add(y, one), S::lt(y, zero));
+            x = S::blend(x, S::sub(x, one), S::gt(x, one));
+            y = S::blend(y, S::sub(y, one), S::gt(y, one));
+        } else {
+            V speed = S::sqrt(S::add(S::mul(vx, vx), S::mul(vy, vy)));
+            V margin = S::narrow(S::mul(speed, five));
+            V turn = S::narrow(S::mul(S::div(speed, five), dt));
+            V high = S::sub(one, margin);
+            vx = S::add(vx, S::bitand_(S::lt(x, margin), turn));
+            vy = S::add(vy, S::bitand_(S::lt(y, margin), turn));
+            vx = S::sub(vx, S::bitand_(S::gt(x, high), turn));
+            vy = S::sub(vy, S::bitand_(S::gt(y, high), turn));
+        }
+
+        V speed = S::sqrt(S::add(S::mul(vx, vx), S::mul(vy, vy)));
+        V fast = S::gt(speed, limit);
+        V scale = S::blend(one, S::div(limit, speed), fast);
+        vx = S::blend(vx, S::mul(vx, scale), fast);
+        vy = S::blend(vy, S::mul(vy, scale), fast);
+
+        S::store(&s.x[i], S::add(x, S::mul(vx, dt)));
+        S::store(&s.y[i], S::add(y, S::mul(vy, dt)));
+        S::store(&s.vx[i], vx);
+        S::store(&s.vy[i], vy);
+    }
+
+    _mm256_zeroupper();
+    integrateScalar(s, i, end, maxVelocity, wrapping, step);
+}
+
+#endif
+
+void accumulate(const Kinematics &state, const Interactions &interactions,
+                const unsigned *neighbors, unsigned n, real x, real y,
+                const Radii &radii, bool wrap, Neighborhood &out)
+{
+#ifdef KERNELS_X86
+    if (selected == Isa::AVX2)
+        return accumulateAVX2<real>(state, interactions, neighbors, n, x, y,
+                                    radii, wrap, out);
+#endif
+    accumulateScalar(state, interactions, neighbors, n, x, y, radii, wrap,
+                     out);
+}
+
+unsigned visible(const Kinematics &state, const unsigned *candidates,
+                 unsigned n, unsigned self, const Cone &cone, bool wrap,
+                 unsigned *out)
+{
+#ifdef KERNELS_X86
+    if (selected == Isa::AVX2)
+        return visibleAVX2<real>(state, candidates, n, self, cone, wrap, out);
+#endif
+    return visibleScalar(state, candidates, n, self, cone, wrap, out);
+}
+
+void integrate(Kinematics &state, unsigned begin, unsigned end,
+               double maxVelocity, bool wrap, double step)
+{
+#ifdef KERNELS_X86
+    if (selected == Isa::AVX2)
+        return integrateAVX2<real>(state, begin, end, maxVelocity, wrap,
+                                   step);
+#endif
+    integrateScalar(state, begin, end, maxVelocity, wrap, step);
+}
+
+}  // namespace kernels
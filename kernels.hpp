@@ -0,0 +1,94 @@
+/**
+ * Inner loops of the simulation, in a scalar version and vectorized
+ * versions selected at runtime from the CPU features.
+ */
+#pragma once
+
+#include <cstdint>
+
+#include "mobile.hpp"
+
+namespace kernels {
+
+enum class Isa { Scalar, AVX2 };
+
+/**
+ * Best instruction set supported by this CPU.
+ */
+Isa detect();
+
+/**
+ * Instruction set in use, the detected one unless forced.
+ */
+Isa current();
+void select(Isa isa);
+
+const char *name(Isa isa);
+
+/**
+ * Squared radii of the four rules.
+ */
+struct Radii {
+    real cohesion2, separation2, alignment2, fear2;
+};
+
+/**
+ * Sums gathered over the neighbors of a boid by the rules. When the space
+ * wraps around, the positions are those of the images of the neighbors
+ * nearest to the boid.
+ */
+struct Neighborhood {
+    real centerX = 0, centerY = 0;  // Sum of positions (cohesion)
+    real awayX = 0, awayY = 0;      // Sum of position - other (separation)
+    real sumX = 0, sumY = 0;        // Sum of velocities (alignment)
+    real predatorX = 0, predatorY = 0;
+    unsigned cohesive = 0, aligned = 0, predators = 0;
+};
+
+/**
+ * Which neighbors the rules of a boid take into account. A neighbor i
+ * counts as a predator when flags[i] & predator is set. With species,
+ * bit species[i] of the masks tells whether the boid flocks with it
+ * (cohesion, separation, alignment) and whether it flees it as well.
+ */
+struct Interactions {
+    const uint8_t *flags = nullptr;
+    uint8_t predator = 0;
+    const uint8_t *species = nullptr;  // None: flock with everyone
+    uint64_t flock = ~uint64_t(0), flee = 0;
+};
+
+/**
+ * Accumulate the neighbors[0, n) of the boid at (x, y), each rule keeping
+ * those within its radius.
+ */
+void accumulate(const Kinematics &state, const Interactions &interactions,
+                const unsigned *neighbors, unsigned n, real x, real y,
+                const Radii &radii, bool wrap, Neighborhood &out);
+
+/**
+ * Field of view of a boid at (x, y) heading along the unit vector
+ * (hx, hy): the points closer than sqrt(radius2) whose direction makes an
+ * angle with the heading of cosine greater than the given one.
+ */
+struct Cone {
+    real x, y, hx, hy;
+    real cosine, radius2;
+};
+
+/**
+ * Write to out the candidates[0, n) in the cone, other than self, and
+ * return how many. out must have room for n indices.
+ */
+unsigned visible(const Kinematics &state, const unsigned *candidates,
+                 unsigned n, unsigned self, const Cone &cone, bool wrap,
+                 unsigned *out);
+
+/**
+ * Bounce (or wrap), limit the speed and move the mobiles [begin, end)
+ * over step times the unit of their velocities.
+ */
+void integrate(Kinematics &state, unsigned begin, unsigned end,
+               double maxVelocity, bool wrap, double step = 1);
+
+}  // namespace kernels
@@ -1,15 +1,24 @@
 #include <SFML/Graphics.hpp>
+#include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <sstream>
+#include <string>
 
 #include "flock.hpp"
+#include "profiler.hpp"
 #include "scene.hpp"
+#include "simulation.hpp"
+#include "trajectory.hpp"
 
 class Window
 {
     int frameRate;
     int width;
     int height;
+    std::string title;
     float fps;
+    unsigned frames;
     sf::RenderWindow window;
 
     sf::Color backgroundColor;
@@ -17,15 +26,22 @@ class Window
     sf::Clock dtClock;
     sf::Clock fpsTimer;
 
+    Profiler profiler;
+    sf::Font font;
+    bool hasFont;
+
    public:
     Window(int width, int height, std::string title)
-        : window(sf::VideoMode(width, height), title),
+        : frameRate(60),
           width(width),
           height(height),
-          frameRate(60)
+          title(title),
+          window(sf::VideoMode(width, height), title)
     {
         backgroundColor = sf::Color(20, 30, 50);
         fps = 0;
+        frames = 0;
+        hasFont = font.loadFromFile("assets/consola.ttf");
     }
 
     void clear() { window.clear(backgroundColor); }
@@ -40,27 +56,101 @@ class Window
 
         sf::View view(
             sf::FloatRect(0, 0, window.getSize().x, window.getSize().y));
-        sf::View originalView = view;
+        window.setView(view);
     }
 
+    /**
+     * Frames drawn per second, over the last second. Call once per frame.
+     */
     float computeFps()
     {
-        if (fpsTimer.getElapsedTime().asSeconds() > 1) {
-            fps = frameRate;
+        frames++;
+        float elapsed = fpsTimer.getElapsedTime().asSeconds();
+        if (elapsed > 1) {
+            fps = frames / elapsed;
+            frames = 0;
             fpsTimer.restart();
         }
         return fps;
     }
 
-    void run()
+    /**
+     * Show what drives the boids (the simulation rate or the replay
+     * position) and the rendering rate in the title bar.
+     */
+    void showStatus(const std::string &status)
+    {
+        std::ostringstream text;
+        text << title << " - " << status << ", render " << std::lround(fps)
+             << " FPS";
+        window.setTitle(text.str());
+    }
+
+    /**
+     * Events common to the live and replay modes.
+     */
+    void handle(const sf::Event &event, Scene &scene)
+    {
+        if (event.type == sf::Event::Closed) window.close();
+
+        // P toggles the timings overlay
+        if (event.type == sf::Event::KeyPressed &&
+            event.key.code == sf::Keyboard::P && hasFont)
+            scene.showProfile(scene.showsProfile() ? nullptr : &profiler,
+                              &font);
+    }
+
+    /**
+     * Draw the boids at alpha of the way from previous to current.
+     */
+    void present(Scene &scene, const Kinematics &previous,
+                 const Kinematics &current, float alpha)
     {
-        //Flock flock(100);
+        {
+            ScopedTimer timer(&profiler, "vertices");
+            scene.update(previous, current, alpha);
+        }
+        {
+            ScopedTimer timer(&profiler, "draw");
+            clear();
+            window.draw(scene);
+        }
+        {
+            ScopedTimer timer(&profiler, "display");
+            display();
+        }
+        profiler.record("frame", dtClock.restart().asSeconds());
+        computeFps();
+    }
+
+    /**
+     * Simulate a flock, recording its steps to a trajectory file when a
+     * path is given.
+     */
+    void run(const std::string &record = "", bool quantize = false)
+    {
+        init();
+
+        Flock flock(1000);
+        flock.profiler = &profiler;
+        Simulation simulation(flock);
         Scene scene(window);
 
+        TrajectoryWriter writer;
+        if (!record.empty()) {
+            if (writer.open(record, flock, frameRate, quantize))
+                simulation.record(&writer);
+            else
+                std::cerr << "Cannot write " << record << std::endl;
+        }
+
+        simulation.setRate(frameRate);
+        simulation.start();
+
         while (window.isOpen()) {
             sf::Event event;
             while (window.pollEvent(event)) {
-                if (event.type == sf::Event::Closed) window.close();
+                handle(event, scene);
                 if (event.type == sf::Event::MouseButtonPressed) {
                     if (event.mouseButton.button == sf::Mouse::Left) {
                         std::cout << "mouse x: " << event.mouseButton.x
@@ -68,21 +158,114 @@ class Window
                         std::cout << "mouse y: " << event.mouseButton.y
                                   << std::endl;
 
-                        scene.add(event.mouseButton.x, event.mouseButton.y, 0);
+                        simulation.add(double(event.mouseButton.x) / width,
+                                       double(event.mouseButton.y) / height);
                     }
                 }
             }
-            clear();
-            scene.draw();
-            // flock.compute();
-            // flock.draw(window);
-            display();
+            // Only the latest states count, skipped ones are never drawn.
+            // The boids are drawn between the two last steps, where the
+            // simulation clock stands.
+            simulation.update();
+            present(scene, simulation.previous(), simulation.state(),
+                    simulation.alpha());
+
+            if (frames == 0)
+                showStatus("sim " +
+                           std::to_string(std::lround(simulation.rate())) +
+                           " Hz");
         }
+        simulation.stop();
+        writer.close();
+
+        std::cout << "Timings over the last frames:\n";
+        profiler.dump(std::cout);
+    }
+
+    /**
+     * Play a trajectory file back at its recording rate, looping. Space
+     * pauses, the arrows jump a second back or forth, Home restarts.
+     */
+    bool replay(const std::string &path)
+    {
+        TrajectoryReader reader;
+        if (!reader.open(path) || reader.frames() == 0) {
+            std::cerr << "Cannot replay " << path << std::endl;
+            return false;
+        }
+        init();
+
+        Scene scene(window);
+        Kinematics previous, current;
+        unsigned last = reader.frames() - 1;
+        double rate = reader.header().rate > 0 ? reader.header().rate : 60;
+        double position = 0;  // In frames
+        unsigned loaded = ~0u;
+        bool paused = false;
+        sf::Clock clock;
+
+        while (window.isOpen()) {
+            sf::Event event;
+            while (window.pollEvent(event)) {
+                handle(event, scene);
+                if (event.type != sf::Event::KeyPressed) continue;
+                if (event.key.code == sf::Keyboard::Space) paused = !paused;
+                if (event.key.code == sf::Keyboard::Home) position = 0;
+                if (event.key.code == sf::Keyboard::Left)
+                    position = std::max(position - rate, 0.0);
+                if (event.key.code == sf::Keyboard::Right)
+                    position = std::min(position + rate, double(last));
+            }
+
+            double elapsed = clock.restart().asSeconds();
+            if (!paused) position += elapsed * rate;
+            if (position > last) position = 0;
+
+            // Any frame is at a known offset, seeking costs no more than
+            // playing
+            unsigned frame = position;
+            if (frame != loaded) {
+                reader.read(frame, previous);
+                reader.read(std::min(frame + 1, last), current);
+                loaded = frame;
+            }
+            present(scene, previous, current, position - frame);
+
+            if (frames == 0)
+                showStatus("replay " + std::to_string(frame + 1) + "/" +
+                           std::to_string(last + 1));
+        }
+
+        std::cout << "Timings over the last frames:\n";
+        profiler.dump(std::cout);
+        return true;
     }
 };
 
+static void usage(const char *program)
+{
+    std::cerr << "Usage: " << program << " [options]\n"
+              << "      --record FILE  Record the simulation to FILE\n"
+              << "      --quantize     Record in 16 bits per value\n"
+              << "      --replay FILE  Play FILE back instead of simulating\n";
+}
+
 int main(int argc, char* argv[])
 {
+    std::string record, replay;
+    bool quantize = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--record" && i + 1 < argc) record = argv[++i];
+        else if (arg == "--replay" && i + 1 < argc) replay = argv[++i];
+        else if (arg == "--quantize") quantize = true;
+        else {
+            usage(argv[0]);
+            return arg == "-h" || arg == "--help" ? 0 : 1;
+        }
+    }
+
     Window window(800, 600, "SFML Boids");
-    window.run();
-}
\ No newline at end of file
+    if (!replay.empty()) return window.replay(replay) ? 0 : 1;
+    window.run(record, quantize);
+}
@@ -1,17 +1,75 @@
 #include "mobile.hpp"
+#include "kernels.hpp"
 
-float Mobile::speed()
+#include <cmath>
+
+void Kinematics::push(const Vector &position, const Vector &velocity)
+{
+    x.push_back(position.x);
+    y.push_back(position.y);
+    vx.push_back(velocity.x);
+    vy.push_back(velocity.y);
+}
+
+void Kinematics::clear()
 {
-    return velocity.norm();
+    x.clear();
+    y.clear();
+    vx.clear();
+    vy.clear();
 }
 
-float Mobile::angle() { return velocity.angle(); }
-float Mobile::angleTo(Mobile &other) { return position.angle(other.position); }
+void Mobile::setPosition(const Vector &position)
+{
+    state->x[index] = position.x;
+    state->y[index] = position.y;
+}
 
-float Mobile::distanceTo(Mobile &other)
+void Mobile::setVelocity(const Vector &velocity)
 {
-    return wrap ? position.toroidal_distance(other.position)
-                : position.distance(other.position);
+    state->vx[index] = velocity.x;
+    state->vy[index] = velocity.y;
+}
+
+float Mobile::speed() const
+{
+    return velocity().norm();
+}
+
+float Mobile::angle() const { return velocity().angle(); }
+
+float Mobile::angleTo(const Mobile &other) const
+{
+    return position().angle(other.position());
+}
+
+float Mobile::distanceTo(const Mobile &other, bool wrap) const
+{
+    return wrap ? position().toroidal_distance(other.position())
+                : position().distance(other.position());
+}
+
+/**
+ * Squared distance, cheaper when only comparing against a radius.
+ */
+real Mobile::distance2To(const Mobile &other, bool wrap) const
+{
+    if (wrap) return position().toroidal_distance2(other.position());
+    real dx = state->x[index] - other.state->x[other.index];
+    real dy = state->y[index] - other.state->y[other.index];
+    return dx * dx + dy * dy;
+}
+
+Vector Mobile::imageOf(const Mobile &other, bool wrap) const
+{
+    Vector image = other.position();
+    if (!wrap) return image;
+    Vector d = image - position();
+    if (d.x > 0.5) image.x -= 1;
+    if (d.x < -0.5) image.x += 1;
+    if (d.y > 0.5) image.y -= 1;
+    if (d.y < -0.5) image.y += 1;
+    return image;
 }
 
 /**
@@ -19,42 +77,34 @@ float Mobile::distanceTo(Mobile &other)
  * a turn factor, at a certain distance (margin) of
  * the edge.
  */
-void Mobile::bounce(float margin, float turnFactor)
+void Mobile::bounce(Kinematics &s, unsigned i, float margin, float turnFactor)
 {
-    if (position.x < margin) velocity.x += turnFactor;
-    if (position.y < margin) velocity.y += turnFactor;
-    if (position.x > 1.0 - margin) velocity.x -= turnFactor;
-    if (position.y > 1.0 - margin) velocity.y -= turnFactor;
+    if (s.x[i] < margin) s.vx[i] += turnFactor;
+    if (s.y[i] < margin) s.vy[i] += turnFactor;
+    if (s.x[i] > 1.0 - margin) s.vx[i] -= turnFactor;
+    if (s.y[i] > 1.0 - margin) s.vy[i] -= turnFactor;
 }
 
 /**
  * The Mobile suddently appear at the opposite of the map
  * if it crosses the boundaries.
  */
-void Mobile::wrap()
+void Mobile::wrap(Kinematics &s, unsigned i)
 {
-    if (position.x < 0) position.x += 1.0;
-    if (position.y < 0) position.y += 1.0;
+    if (s.x[i] < 0) s.x[i] += 1.0;
+    if (s.y[i] < 0) s.y[i] += 1.0;
 
-    if (position.x > 1.0) position.x -= 1.0;
-    if (position.y > 1.0) position.y -= 1.0;
+    if (s.x[i] > 1.0) s.x[i] -= 1.0;
+    if (s.y[i] > 1.0) s.y[i] -= 1.0;
 }
 
-
-void Mobile::update()
+void Mobile::update(Kinematics &s, unsigned begin, unsigned end,
+                    double maxVelocity, bool wrapping, double step)
 {
-    if (wrap)
-        wrap();
-    else
-        bounce(speed() * 5.0, speed() / 5.0);
-
-    // Update position
-    velocity.limit(max_velocity);
-    position += velocity;
+    kernels::integrate(s, begin, end, maxVelocity, wrapping, step);
+}
 
-    // Record previous position
-    if (history.size() > max_history)
-        history.pop_front();
-    
-    history.push_back(position);
-}
\ No newline at end of file
+void Mobile::update(double maxVelocity, bool wrap, double step)
+{
+    update(*state, index, index + 1, maxVelocity, wrap, step);
+}
@@ -1,29 +1,73 @@
+#pragma once
+
 #include "vector.hpp"
-#include <deque>
 
+#include <vector>
+
+/**
+ * Kinematic state of a set of mobiles, stored as one contiguous array
+ * per component (structure of arrays) so the hot loops only touch the
+ * data they need.
+ */
+struct Kinematics {
+    std::vector<real> x, y;    // Positions
+    std::vector<real> vx, vy;  // Velocities
+
+    unsigned size() const { return x.size(); }
+
+    void push(const Vector &position, const Vector &velocity);
+    void clear();
+};
+
+/**
+ * Lightweight handle on one mobile of a Kinematics.
+ */
 class Mobile {
 protected:
-    bool wrap;
-    float max_velocity;
-
-    std::deque<Vector> history;
-    int max_history;
+    Kinematics *state;
+    unsigned index;
 
 public:
-    Vector position;
-    Vector velocity;
+    Mobile(Kinematics &state, unsigned index) : state(&state), index(index) {}
+
+    unsigned id() const { return index; }
+
+    Vector position() const { return Vector(state->x[index], state->y[index]); }
+    Vector velocity() const { return Vector(state->vx[index], state->vy[index]); }
 
-    float angle();
-    float speed();
+    void setPosition(const Vector &position);
+    void setVelocity(const Vector &velocity);
 
-    float angleTo(Mobile &other);
-    float distanceTo(Mobile &other);
+    float angle() const;
+    float speed() const;
+
+    float angleTo(const Mobile &other) const;
+    float distanceTo(const Mobile &other, bool wrap = false) const;
+    real distance2To(const Mobile &other, bool wrap = false) const;
+
+    /**
+     * Position of the other Mobile, or of its image nearest to this one
+     * when the space wraps around.
+     */
+    Vector imageOf(const Mobile &other, bool wrap = false) const;
+
+    bool operator==(const Mobile &other) const
+    {
+        return state == other.state && index == other.index;
+    }
 
     /**
      * Edges
      */
-    void bounce(float margin, float turnFactor);
-    void wrap();
+    static void bounce(Kinematics &state, unsigned i, float margin, float turnFactor);
+    static void wrap(Kinematics &state, unsigned i);
+
+    /**
+     * Integrate the mobiles [begin, end) over one step, of step times the
+     * unit of the velocities.
+     */
+    static void update(Kinematics &state, unsigned begin, unsigned end,
+                       double maxVelocity, bool wrap, double step = 1);
 
-    void update();    
-};
\ No newline at end of file
+    void update(double maxVelocity, bool wrap, double step = 1);
+};
@@ -0,0 +1,68 @@
+/**
+ * Timings of the phases of a frame.
+ */
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+
+void Profiler::record(const char *phase, double seconds)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto it = std::find_if(phases.begin(), phases.end(),
+                           [&](const Phase &p) { return p.name == phase; });
+    if (it == phases.end()) {
+        phases.emplace_back();
+        it = phases.end() - 1;
+        it->name = phase;
+        it->samples.reserve(window);
+    }
+
+    if (it->samples.size() < window)
+        it->samples.push_back(seconds);
+    else
+        it->samples[it->next] = seconds;
+    it->next = (it->next + 1) % window;
+}
+
+std::vector<Profiler::Stats> Profiler::statistics() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    std::vector<Stats> stats;
+    std::vector<double> sorted;
+    for (auto &phase : phases) {
+        sorted = phase.samples;
+        unsigned n = sorted.size();
+        if (!n) continue;
+
+        double sum = 0;
+        for (double s : sorted) sum += s;
+        auto p99 = sorted.begin() + (std::ceil(n * 0.99) - 1);
+        std::nth_element(sorted.begin(), p99, sorted.end());
+
+        stats.push_back({phase.name, n,
+                         *std::min_element(sorted.begin(), sorted.end()) * 1e3,
+                         sum / n * 1e3, *p99 * 1e3});
+    }
+    return stats;
+}
+
+void Profiler::dump(std::ostream &out) const
+{
+    std::ios::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+
+    out << std::left << std::setw(12) << "phase" << std::right
+        << std::setw(10) << "min ms" << std::setw(10) << "mean ms"
+        << std::setw(10) << "p99 ms" << "\n";
+    for (auto &s : statistics())
+        out << std::left << std::setw(12) << s.name << std::right
+            << std::fixed << std::setprecision(3) << std::setw(10) << s.min
+            << std::setw(10) << s.mean << std::setw(10) << s.p99 << "\n";
+
+    out.flags(flags);
+    out.precision(precision);
+}
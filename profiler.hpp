@@ -0,0 +1,81 @@
+/**
+ * Timings of the phases of a frame.
+ */
+#pragma once
+
+#include <chrono>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * Keeps the last durations of each named phase and summarizes them. Phases
+ * may be recorded from several threads (the simulation and the renderer).
+ */
+class Profiler
+{
+    struct Phase {
+        std::string name;
+        std::vector<double> samples;  // Ring buffer, in seconds
+        unsigned next = 0;
+    };
+
+    mutable std::mutex mutex;
+    unsigned window;
+    std::vector<Phase> phases;  // In order of first record
+
+   public:
+    /**
+     * In milliseconds, over the samples kept.
+     */
+    struct Stats {
+        std::string name;
+        unsigned samples;
+        double min, mean, p99;
+    };
+
+    /**
+     * @param window Samples kept per phase
+     */
+    explicit Profiler(unsigned window = 240) : window(window ? window : 1) {}
+
+    void record(const char *phase, double seconds);
+
+    std::vector<Stats> statistics() const;
+
+    /**
+     * One line per phase.
+     */
+    void dump(std::ostream &out) const;
+};
+
+/**
+ * Records the time from its construction to its destruction as a phase.
+ * Does nothing, not even reading the clock, without a profiler.
+ */
+class ScopedTimer
+{
+    using Clock = std::chrono::steady_clock;
+
+    Profiler *profiler;
+    const char *phase;
+    Clock::time_point start;
+
+   public:
+    ScopedTimer(Profiler *profiler, const char *phase)
+        : profiler(profiler), phase(phase)
+    {
+        if (profiler) start = Clock::now();
+    }
+
+    ~ScopedTimer()
+    {
+        if (!profiler) return;
+        std::chrono::duration<double> elapsed = Clock::now() - start;
+        profiler->record(phase, elapsed.count());
+    }
+
+    ScopedTimer(const ScopedTimer &) = delete;
+    ScopedTimer &operator=(const ScopedTimer &) = delete;
+};
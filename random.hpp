@@ -0,0 +1,74 @@
+/**
+ * Reproducible random numbers.
+ */
+#pragma once
+
+#include <cstdint>
+
+/**
+ * Counter-based generator: the n-th number of a stream is a hash of the
+ * seed, the stream and n (the SplitMix64 mix), so there is no state to
+ * share between threads and any stream can be drawn from anywhere, in any
+ * order, with the same results.
+ */
+class Random
+{
+    uint64_t key;
+
+   public:
+    /**
+     * Finalizer of SplitMix64, a bijection that spreads every input bit.
+     */
+    static constexpr uint64_t mix(uint64_t z)
+    {
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+    }
+
+    explicit constexpr Random(uint64_t seed = 0) : key(mix(seed)) {}
+
+    /**
+     * Sequence of numbers, identified by up to two ids (e.g. a boid index
+     * and a step).
+     */
+    class Stream
+    {
+        uint64_t base;
+        uint64_t counter = 0;
+
+       public:
+        explicit constexpr Stream(uint64_t base) : base(base) {}
+
+        /**
+         * Next 64 random bits.
+         */
+        constexpr uint64_t next()
+        {
+            return mix(base + 0x9e3779b97f4a7c15ull * ++counter);
+        }
+
+        /**
+         * Uniform in [0, 1).
+         */
+        constexpr double uniform() { return (next() >> 11) * 0x1.0p-53; }
+
+        /**
+         * Uniform in [offset, offset + range).
+         */
+        constexpr double uniform(double range, double offset = 0)
+        {
+            return uniform() * range + offset;
+        }
+
+        /**
+         * Skip to the n-th number.
+         */
+        constexpr void seek(uint64_t n) { counter = n; }
+    };
+
+    constexpr Stream stream(uint64_t id, uint64_t sub = 0) const
+    {
+        return Stream(mix(mix(key ^ mix(id)) + sub));
+    }
+};
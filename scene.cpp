@@ -1,45 +1,96 @@
 #include "scene.hpp"
-#include "flock.hpp"
 
 #include <SFML/Graphics.hpp>
+#include <algorithm>
+#include <cmath>
+#include <sstream>
 
-Scene::Scene(sf::RenderWindow &window, Flock &flock) : window(window), shape(sf::Triangles), tails(sf::Lines)
+Scene::Scene(sf::RenderWindow &window) :
+    window(window),
+    buffer(sf::Triangles, sf::VertexBuffer::Stream),
+    useBuffer(sf::VertexBuffer::isAvailable()),
+    color(150, 120, 156, 150)
 {
 }
 
-void Scene::add(sf::VertexArray &array, float x, float y, float angle)
+void Scene::update(const Kinematics &state) { update(state, state, 1); }
+
+void Scene::update(const Kinematics &previous, const Kinematics &state,
+                   float alpha)
+{
+    const float boidWidth = 3;
+    const float boidHeight = 10;
+
+    unsigned n = state.size();
+
+    // Only reallocate when the flock grows past the capacity
+    if (shapes.size() != n * 3) {
+        shapes.resize(n * 3, sf::Vertex(sf::Vector2f(), color));
+        if (useBuffer && shapes.size() > buffer.getVertexCount())
+            useBuffer = buffer.create(std::max(shapes.size(),
+                                               2 * buffer.getVertexCount()));
+    }
+
+    float width = window.getSize().x;
+    float height = window.getSize().y;
+
+    // Each boid is a triangle pointing along its velocity. The direction
+    // is enough to orient it, no angle nor transform is needed.
+    sf::Vertex *v = shapes.data();
+    unsigned before = std::min(previous.size(), n);
+    for (unsigned i = 0; i < n; i++, v += 3) {
+        float px = state.x[i], py = state.y[i];
+        if (i < before) {
+            // Not across the edges when the space wraps around
+            float dx = state.x[i] - previous.x[i];
+            float dy = state.y[i] - previous.y[i];
+            if (std::fabs(dx) < 0.5f && std::fabs(dy) < 0.5f) {
+                px = previous.x[i] + dx * alpha;
+                py = previous.y[i] + dy * alpha;
+            }
+        }
+        float x = px * width;
+        float y = py * height;
+
+        float dx = state.vx[i], dy = state.vy[i];
+        float norm = std::sqrt(dx * dx + dy * dy);
+        if (norm > 0) {
+            dx /= norm;
+            dy /= norm;
+        } else {
+            dx = 0;
+            dy = 1;
+        }
+
+        // Tip at the position, base boidHeight behind
+        float bx = x - dx * boidHeight, by = y - dy * boidHeight;
+        v[0].position = sf::Vector2f(x, y);
+        v[1].position = sf::Vector2f(bx - dy * boidWidth, by + dx * boidWidth);
+        v[2].position = sf::Vector2f(bx + dy * boidWidth, by - dx * boidWidth);
+    }
+
+    if (useBuffer && !shapes.empty())
+        buffer.update(shapes.data(), shapes.size(), 0);
+}
+
+void Scene::showProfile(const Profiler *profiler, const sf::Font *font)
 {
-    int boidWidth = 3;
-    int boidHeight = 10;
-
-    // set the center position
-    sf::Vertex v1(sf::Vector2f(x, y));
-    sf::Vertex v2(
-        sf::Vector2f(v1.position.x - boidWidth, v1.position.y - boidHeight));
-    sf::Vertex v3(
-        sf::Vector2f(v1.position.x + boidWidth, v1.position.y - boidHeight));
-
-    // setting color
-    v1.color = v2.color = v3.color = sf::Color(150, 120, 156, 150);
-
-    // set the angle
-    sf::Transform transform;
-    transform.rotate(angle, (v2.position.x + v3.position.x) / 2,
-                     v1.position.y - 5);
-    v1.position = transform.transformPoint(v1.position);
-    v2.position = transform.transformPoint(v2.position);
-    v3.position = transform.transformPoint(v3.position);
-
-    // appending them into vertex array
-    array.append(v1);
-    array.append(v2);
-    array.append(v3);
+    this->profiler = profiler;
+    this->font = font;
 }
 
 void Scene::draw(sf::RenderTarget &target, sf::RenderStates states) const { 
-    sf::VertexArray array(sf::Triangles, flock.boids.size() * 3);
-    for (auto &boid : flock.boids) {
-        add(array, boid.position.x, boid.position.y, boid.angle);
+    if (useBuffer)
+        target.draw(buffer, 0, shapes.size(), states);
+    else if (!shapes.empty())
+        target.draw(shapes.data(), shapes.size(), sf::Triangles, states);
+
+    if (profiler && font) {
+        std::ostringstream text;
+        profiler->dump(text);
+        sf::Text overlay(text.str(), *font, 12);
+        overlay.setFillColor(sf::Color(220, 220, 220));
+        overlay.setPosition(8, 8);
+        target.draw(overlay, states);
     }
-    window.draw(array); 
 }
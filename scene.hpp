@@ -1,22 +1,49 @@
 #pragma once
 
-#include "flock.hpp"
+#include "mobile.hpp"
+#include "profiler.hpp"
 #include <SFML/Graphics.hpp>
-#include <map>
+#include <vector>
 
+/**
+ * Draws the boids of a flock from a copy of its state, so it can run on
+ * another thread than the simulation. The vertices are kept from one
+ * frame to the next and rewritten in place, so drawing does not allocate.
+ */
 class Scene : public sf::Drawable
 {
-    int width, height;
-    sf::VertexArray shape; // Boid shapes
-    sf::VertexArray tails; // Boid tails
-
     sf::RenderWindow &window;
 
-    Flock &flock;
+    std::vector<sf::Vertex> shapes;  // Boid shapes, three vertices per boid
+    sf::VertexBuffer buffer;         // Same, on the GPU when available
+    bool useBuffer;
+
+    sf::Color color;
+
+    // Timings drawn over the flock when set
+    const Profiler *profiler = nullptr;
+    const sf::Font *font = nullptr;
 
-    void add(sf::VertexArray &array, float x, float y, float angle);
 public:
-    Scene(sf::RenderWindow &window, Flock &flock);
+    explicit Scene(sf::RenderWindow &window);
+
+    /**
+     * Rewrite the vertices from a state of the flock.
+     */
+    void update(const Kinematics &state);
+
+    /**
+     * Same, at alpha of the way from the previous state to the current one
+     * (the boids added since only show up at their current position).
+     */
+    void update(const Kinematics &previous, const Kinematics &current,
+                float alpha);
+
+    /**
+     * Show the statistics of a profiler in a corner, or nothing when null.
+     */
+    void showProfile(const Profiler *profiler, const sf::Font *font);
+    bool showsProfile() const { return profiler; }
 
     void draw(sf::RenderTarget& target, sf::RenderStates states) const;
-};
\ No newline at end of file
+};
@@ -0,0 +1,108 @@
+/**
+ * Flock stepped on a thread of its own.
+ */
+#include "simulation.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+Simulation::Simulation(Flock &flock) : flock(flock)
+{
+    // Something to draw before the first step
+    Frame &frame = frames.back();
+    frame.previous = frame.current = flock.kinematics();
+    frame.time = Clock::now();
+    frames.publish();
+}
+
+Simulation::~Simulation() { stop(); }
+
+void Simulation::start()
+{
+    if (running) return;
+    running = true;
+    thread = std::thread(&Simulation::run, this);
+}
+
+void Simulation::stop()
+{
+    running = false;
+    if (thread.joinable()) thread.join();
+}
+
+void Simulation::add(double x, double y)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    pending.emplace_back(x, y);
+}
+
+float Simulation::alpha() const
+{
+    const Frame &frame = frames.front();
+    if (frame.dt <= 0) return 1;
+    std::chrono::duration<double> elapsed = Clock::now() - frame.time;
+    return std::min(std::max(elapsed.count() / frame.dt, 0.0), 1.0);
+}
+
+void Simulation::run()
+{
+    std::vector<Vector> added;
+    auto last = Clock::now();
+    auto since = last;
+    double accumulator = 0;
+    unsigned stepsDone = 0;
+
+    while (running) {
+        double hz = targetRate;
+        double dt = hz > 0 ? 1 / hz : 0;
+
+        auto now = Clock::now();
+        accumulator += std::chrono::duration<double>(now - last).count();
+        last = now;
+
+        unsigned steps = 1;
+        if (dt > 0) {
+            if (accumulator < dt) {
+                std::this_thread::sleep_for(
+                    std::chrono::duration<double>(dt - accumulator));
+                continue;
+            }
+            steps = std::min<unsigned>(accumulator / dt, maxSteps);
+            accumulator -= steps * dt;
+            if (accumulator >= dt) accumulator = std::fmod(accumulator, dt);
+        } else {
+            accumulator = 0;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            added.swap(pending);
+        }
+        for (auto &position : added) flock.add(position);
+        added.clear();
+
+        // Only the last of the steps is published. The copies reuse the
+        // storage of the slot, no allocation once sized.
+        Frame &frame = frames.back();
+        flock.timeStep = dt > 0 ? dt * referenceRate : 1;
+        for (unsigned i = 0; i < steps; i++) {
+            if (i + 1 == steps) frame.previous = flock.kinematics();
+            flock.compute();
+            if (recorder) recorder->write(flock.kinematics());
+        }
+        frame.current = flock.kinematics();
+        frame.time = now - std::chrono::duration_cast<Clock::duration>(
+                               std::chrono::duration<double>(accumulator));
+        frame.dt = dt;
+        frames.publish();
+
+        stepsDone += steps;
+        if (now - since >= std::chrono::seconds(1)) {
+            std::chrono::duration<double> elapsed = now - since;
+            measuredRate = stepsDone / elapsed.count();
+            stepsDone = 0;
+            since = now;
+        }
+    }
+}
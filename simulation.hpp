@@ -0,0 +1,123 @@
+/**
+ * Flock stepped on a thread of its own.
+ */
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "flock.hpp"
+#include "mobile.hpp"
+#include "trajectory.hpp"
+#include "triple-buffer.hpp"
+#include "vector.hpp"
+
+/**
+ * Runs a flock on a background thread at a fixed rate and publishes the
+ * state after each step through a triple buffer, so a reader (the
+ * renderer) never blocks the simulation nor the other way round. Once
+ * started, the flock must only be touched through this class.
+ *
+ * The steps are paced by an accumulator of elapsed time: each step
+ * consumes a fixed dt, a late thread catches up by a few steps at most.
+ * The reader interpolates between the two last states with alpha().
+ * Each step advances the flock by dt (see Flock::timeStep), so the boids
+ * fly the same in world time whatever the rate.
+ */
+class Simulation
+{
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     * What is published: the states before and after the last step, and
+     * the time the latter stands for on the simulation clock.
+     */
+    struct Frame {
+        Kinematics previous, current;
+        Clock::time_point time;
+        double dt = 0;
+    };
+
+    Flock &flock;
+    TripleBuffer<Frame> frames;
+
+    std::thread thread;
+    std::atomic<bool> running{false};
+
+    std::atomic<double> targetRate{60};
+    std::atomic<unsigned> maxSteps{5};
+    std::atomic<double> measuredRate{0};
+
+    TrajectoryWriter *recorder = nullptr;
+
+    // Boids to add at the next step, rare enough for a lock
+    std::mutex mutex;
+    std::vector<Vector> pending;
+
+    void run();
+
+   public:
+    explicit Simulation(Flock &flock);
+    ~Simulation();
+
+    Simulation(const Simulation &) = delete;
+    Simulation &operator=(const Simulation &) = delete;
+
+    void start();
+    void stop();
+
+    /**
+     * Rate the parameters of the flock are tuned for, one of its steps
+     * at this rate being a time step of 1.
+     */
+    static constexpr double referenceRate = 60;
+
+    /**
+     * Steps per second, which sets the fixed dt of a step. 0 steps as fast
+     * as possible, each a reference step, without interpolation.
+     */
+    void setRate(double hz) { targetRate = hz; }
+
+    /**
+     * Most steps taken at once to catch up after falling behind, the rest
+     * of the delay is dropped so a slow flock does not spiral.
+     */
+    void setMaxSteps(unsigned steps) { maxSteps = steps; }
+
+    /**
+     * Steps per second actually achieved, over the last second.
+     */
+    double rate() const { return measuredRate; }
+
+    /**
+     * Append every step to a trajectory, or stop with null. Only before
+     * start().
+     */
+    void record(TrajectoryWriter *writer) { recorder = writer; }
+
+    /**
+     * Add a boid before the next step.
+     */
+    void add(double x, double y);
+
+    /**
+     * Take the latest published state, returns whether it changed. Only
+     * from the thread reading the states.
+     */
+    bool update() { return frames.update(); }
+
+    /**
+     * States before and after the last step taken.
+     */
+    const Kinematics &previous() const { return frames.front().previous; }
+    const Kinematics &state() const { return frames.front().current; }
+
+    /**
+     * How far the simulation clock is from previous() (0) to state() (1),
+     * for drawing in between.
+     */
+    float alpha() const;
+};
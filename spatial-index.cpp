@@ -0,0 +1,175 @@
+/**
+ * Spatial indexes answering the neighborhood queries of a flock.
+ */
+#include "spatial-index.hpp"
+#include "grid.hpp"
+
+#include <algorithm>
+
+std::unique_ptr<SpatialIndex> SpatialIndex::create(Type type)
+{
+    switch (type) {
+        case Type::Grid:
+            return std::unique_ptr<SpatialIndex>(new GridIndex());
+        case Type::ImplicitKDTree:
+            return std::unique_ptr<SpatialIndex>(new ImplicitKDTreeIndex());
+        case Type::KDTree:
+        default:
+            return std::unique_ptr<SpatialIndex>(new KDTreeIndex());
+    }
+}
+
+void KDTreeIndex::build(Kinematics &state, double radius, bool wrap)
+{
+    this->wrap = wrap;
+    size = state.size();
+    tree.build(state.x.data(), state.y.data(), size);
+}
+
+/**
+ * Into a scratch buffer of the thread, grown and searched again only when
+ * it is too small, then appended to neighbors.
+ */
+void KDTreeIndex::search(const Vector &position, double radius,
+                         std::vector<unsigned> &neighbors)
+{
+    thread_local std::vector<uint32_t> found(64);
+    for (;;) {
+        size_t count =
+            wrap ? tree.search(position.x, position.y, radius, 1.0, 1.0,
+                               found.data(), found.size())
+                 : tree.search(position.x, position.y, radius, found.data(),
+                               found.size());
+        if (count <= found.size()) {
+            neighbors.insert(neighbors.end(), found.begin(),
+                             found.begin() + count);
+            return;
+        }
+        found.resize(count);
+    }
+}
+
+void KDTreeIndex::nearest(const Vector &position, unsigned k, double radius,
+                          std::vector<unsigned> &neighbors)
+{
+    thread_local std::vector<std::pair<double, IndexedPoint>> found;
+    if (wrap)
+        tree.nearest(position.x, position.y, k, radius, 1.0, 1.0, found);
+    else
+        tree.nearest(position.x, position.y, k, radius, found);
+    for (auto &neighbor : found) neighbors.push_back(neighbor.second.index);
+}
+
+/**
+ * One traversal of the tree against itself for all the pairs, then the
+ * lists of each mobile laid out by counting.
+ */
+void KDTreeIndex::searchAll(double radius, std::vector<unsigned> &offsets,
+                            std::vector<unsigned> &neighbors)
+{
+    pairs.clear();
+    auto visit = [&](const IndexedPoint &a, const IndexedPoint &b, double) {
+        pairs.emplace_back(a.index, b.index);
+    };
+    if (wrap)
+        tree.searchPairs(radius, 1.0, 1.0, visit);
+    else
+        tree.searchPairs(radius, visit);
+
+    offsets.assign(size + 1, 0);
+    for (auto &pair : pairs) {
+        offsets[pair.first + 1]++;
+        offsets[pair.second + 1]++;
+    }
+    for (unsigned i = 0; i < size; i++) offsets[i + 1] += offsets[i];
+
+    next.assign(offsets.begin(), offsets.end() - 1);
+    neighbors.resize(offsets.back());
+    for (auto &pair : pairs) {
+        neighbors[next[pair.first]++] = pair.second;
+        neighbors[next[pair.second]++] = pair.first;
+    }
+}
+
+void ImplicitKDTreeIndex::build(Kinematics &state, double radius, bool wrap)
+{
+    this->wrap = wrap;
+    if (refitThreshold >= 0 && indexed == &state &&
+        handles.size() == state.size()) {
+        tree.refit(refitThreshold);
+        return;
+    }
+
+    indexed = &state;
+    handles.clear();
+    for (unsigned i = 0; i < state.size(); i++) handles.emplace_back(state, i);
+    tree.build(handles.begin(), handles.end());
+}
+
+void ImplicitKDTreeIndex::search(const Vector &position, double radius,
+                                 std::vector<unsigned> &neighbors)
+{
+    auto visit = [&](const Mobile &mobile, double) {
+        neighbors.push_back(mobile.id());
+    };
+    if (wrap)
+        tree.search(position.x, position.y, radius, 1.0, 1.0, visit);
+    else
+        tree.search(position.x, position.y, radius, visit);
+}
+
+void ImplicitKDTreeIndex::nearest(const Vector &position, unsigned k,
+                                  double radius,
+                                  std::vector<unsigned> &neighbors)
+{
+    thread_local std::vector<std::pair<double, Mobile>> found;
+    if (wrap)
+        tree.nearest(position.x, position.y, k, radius, 1.0, 1.0, found);
+    else
+        tree.nearest(position.x, position.y, k, radius, found);
+    for (auto &neighbor : found) neighbors.push_back(neighbor.second.id());
+}
+
+/**
+ * The mobiles are searched in the order of the leaves, one after its
+ * neighbors, so consecutive searches walk the same few nodes. Their
+ * lists are then moved to the order of the mobiles.
+ */
+void ImplicitKDTreeIndex::searchAll(double radius,
+                                    std::vector<unsigned> &offsets,
+                                    std::vector<unsigned> &neighbors)
+{
+    offsets.assign(handles.size() + 1, 0);
+    found.clear();
+    tree.traverse([&](const Mobile &mobile) {
+        size_t first = found.size();
+        search(mobile.position(), radius, found);
+        found.erase(std::remove(found.begin() + first, found.end(),
+                                mobile.id()),
+                    found.end());
+        offsets[mobile.id() + 1] = found.size() - first;
+    });
+    for (unsigned i = 0; i < handles.size(); i++) offsets[i + 1] += offsets[i];
+
+    neighbors.resize(found.size());
+    auto list = found.begin();
+    tree.traverse([&](const Mobile &mobile) {
+        unsigned i = mobile.id();
+        auto end = list + (offsets[i + 1] - offsets[i]);
+        std::copy(list, end, neighbors.begin() + offsets[i]);
+        list = end;
+    });
+}
+
+void SpatialIndex::keepNearest(
+    std::vector<std::pair<double, unsigned>> &candidates, unsigned k,
+    std::vector<unsigned> &neighbors)
+{
+    if (candidates.size() > k) {
+        std::nth_element(candidates.begin(), candidates.begin() + k,
+                         candidates.end());
+        candidates.resize(k);
+    }
+    std::sort(candidates.begin(), candidates.end());
+    for (auto &candidate : candidates) neighbors.push_back(candidate.second);
+}
@@ -0,0 +1,133 @@
+/**
+ * Spatial indexes answering the neighborhood queries of a flock.
+ */
+#pragma once
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "implicit-kd-tree.hpp"
+#include "kd-tree.hpp"
+#include "mobile.hpp"
+#include "vector.hpp"
+
+template <>
+struct Position<Mobile> {
+    static real getX(Mobile const &p) { return p.position().x; }
+    static real getY(Mobile const &p) { return p.position().y; }
+};
+
+class SpatialIndex
+{
+   public:
+    enum class Type { KDTree, ImplicitKDTree, Grid };
+
+    static std::unique_ptr<SpatialIndex> create(Type type);
+
+    virtual ~SpatialIndex() = default;
+
+    /**
+     * Index the mobiles at their current positions.
+     * @param state Mobiles to index, must outlive the next build
+     * @param radius Largest radius that will be searched
+     * @param wrap Whether the unit square wraps around
+     */
+    virtual void build(Kinematics &state, double radius, bool wrap) = 0;
+
+    /**
+     * Collect the indices of the mobiles closer than a radius from a
+     * position. Safe to call from several threads at once.
+     */
+    virtual void search(const Vector &position, double radius,
+                        std::vector<unsigned> &neighbors) = 0;
+
+    /**
+     * Collect the indices of the k mobiles nearest to a position and
+     * closer than a radius, by increasing distance. Safe to call from
+     * several threads at once.
+     */
+    virtual void nearest(const Vector &position, unsigned k, double radius,
+                         std::vector<unsigned> &neighbors) = 0;
+
+    /**
+     * Search around every indexed mobile at once. The indices of those
+     * closer than the radius to mobile i, itself excluded, end up in
+     * neighbors[offsets[i]] to neighbors[offsets[i + 1] - 1].
+     */
+    virtual void searchAll(double radius, std::vector<unsigned> &offsets,
+                           std::vector<unsigned> &neighbors) = 0;
+
+    /**
+     * Append the indices of the k nearest candidates, given as (squared
+     * distance, index), by increasing distance. Reorders candidates.
+     */
+    static void keepNearest(
+        std::vector<std::pair<double, unsigned>> &candidates, unsigned k,
+        std::vector<unsigned> &neighbors);
+
+    /**
+     * Whether the distances are measured in the wrapped space when the
+     * index was built with wrap enabled.
+     */
+    virtual bool periodic() const { return false; }
+
+    /**
+     * Let build() refit the index to the new positions of the same
+     * mobiles rather than build it again, for the indexes that can (see
+     * ImplicitKDTree::refit). A negative threshold always builds.
+     */
+    virtual void setRefit(double threshold) {}
+    virtual RefitStatistics refitStatistics() const { return {}; }
+};
+
+/**
+ * KD-tree over the positions of the mobiles, holding their indices.
+ */
+class KDTreeIndex : public SpatialIndex
+{
+    KDTree<IndexedPoint> tree;
+    unsigned size = 0;
+    std::vector<std::pair<unsigned, unsigned>> pairs;  // Of searchAll()
+    std::vector<unsigned> next;  // Free slot of each list, in searchAll()
+    bool wrap = false;
+
+   public:
+    void build(Kinematics &state, double radius, bool wrap) override;
+    void search(const Vector &position, double radius,
+                std::vector<unsigned> &neighbors) override;
+    void nearest(const Vector &position, unsigned k, double radius,
+                 std::vector<unsigned> &neighbors) override;
+    void searchAll(double radius, std::vector<unsigned> &offsets,
+                   std::vector<unsigned> &neighbors) override;
+    bool periodic() const override { return true; }
+};
+
+/**
+ * Same as KDTreeIndex over the pointer-free tree, the searches of
+ * searchAll() run leaf by leaf.
+ */
+class ImplicitKDTreeIndex : public SpatialIndex
+{
+    ImplicitKDTree<Mobile> tree;
+    std::vector<Mobile> handles;
+    std::vector<unsigned> found;  // Of searchAll(), in leaf order
+    bool wrap = false;
+    const Kinematics *indexed = nullptr;  // By the last build
+    double refitThreshold = -1;
+
+   public:
+    void build(Kinematics &state, double radius, bool wrap) override;
+    void search(const Vector &position, double radius,
+                std::vector<unsigned> &neighbors) override;
+    void nearest(const Vector &position, unsigned k, double radius,
+                 std::vector<unsigned> &neighbors) override;
+    void searchAll(double radius, std::vector<unsigned> &offsets,
+                   std::vector<unsigned> &neighbors) override;
+    bool periodic() const override { return true; }
+    void setRefit(double threshold) override { refitThreshold = threshold; }
+    RefitStatistics refitStatistics() const override
+    {
+        return tree.statistics();
+    }
+};
@@ -0,0 +1,74 @@
+/**
+ * Fixed set of worker threads sharing parallel loops.
+ */
+#include "threadpool.hpp"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(unsigned threads)
+{
+    for (unsigned i = 1; i < threads; i++)
+        workers.emplace_back(&ThreadPool::work, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto &worker : workers) worker.join();
+}
+
+void ThreadPool::drain()
+{
+    unsigned begin;
+    while ((begin = next.fetch_add(chunk)) < total)
+        task(begin, std::min(begin + chunk, total));
+}
+
+void ThreadPool::work()
+{
+    unsigned long seen = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping) return;
+            seen = generation;
+        }
+
+        drain();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--pending == 0) done.notify_one();
+    }
+}
+
+void ThreadPool::parallelFor(
+    unsigned n, std::function<void(unsigned begin, unsigned end)> task)
+{
+    if (workers.empty() || n == 0) {
+        if (n > 0) task(0, n);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        this->task = std::move(task);
+        total = n;
+        // A few chunks per thread to balance the load, but large enough
+        // to keep the threads from writing to the same cache lines.
+        chunk = std::max(64u, n / (size() * 8));
+        next = 0;
+        pending = workers.size();
+        generation++;
+    }
+    wake.notify_all();
+
+    drain();
+
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [&] { return pending == 0; });
+}
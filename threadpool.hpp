@@ -0,0 +1,48 @@
+/**
+ * Fixed set of worker threads sharing parallel loops.
+ */
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+{
+    std::vector<std::thread> workers;
+
+    std::mutex mutex;
+    std::condition_variable wake, done;
+    unsigned long generation = 0;  // Incremented at each new loop
+    unsigned pending = 0;          // Workers still busy on the loop
+    bool stopping = false;
+
+    std::function<void(unsigned begin, unsigned end)> task;
+    std::atomic<unsigned> next{0};
+    unsigned total = 0, chunk = 1;
+
+    void work();
+    void drain();
+
+   public:
+    /**
+     * @param threads Total number of threads, the caller included
+     */
+    explicit ThreadPool(unsigned threads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    unsigned size() const { return workers.size() + 1; }
+
+    /**
+     * Run task over [0, n) split in chunks handed out to the threads as
+     * they become free. Returns once the whole range is processed.
+     */
+    void parallelFor(unsigned n,
+                     std::function<void(unsigned begin, unsigned end)> task);
+};
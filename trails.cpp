@@ -0,0 +1,51 @@
+/**
+ * Trail history of a flock.
+ */
+#include "trails.hpp"
+
+#include <algorithm>
+
+void Trails::reset(unsigned boids, unsigned length)
+{
+    capacity = length;
+    head = count = 0;
+    points.assign(static_cast<size_t>(boids) * length, Vector());
+}
+
+/**
+ * A new boid starts with its whole trail at its position.
+ */
+void Trails::add(const Vector &position)
+{
+    points.insert(points.end(), capacity, position);
+}
+
+void Trails::restart(unsigned boid, const Vector &position)
+{
+    std::fill_n(points.begin() + size_t(boid) * capacity, capacity, position);
+}
+
+void Trails::erase(unsigned first, unsigned last)
+{
+    points.erase(points.begin() + size_t(first) * capacity,
+                 points.begin() + size_t(last) * capacity);
+}
+
+void Trails::rotate(unsigned first, unsigned middle, unsigned last)
+{
+    std::rotate(points.begin() + size_t(first) * capacity,
+                points.begin() + size_t(middle) * capacity,
+                points.begin() + size_t(last) * capacity);
+}
+
+void Trails::record(const Kinematics &state)
+{
+    if (capacity == 0) return;
+
+    Vector *slot = points.data() + head;
+    for (unsigned i = 0; i < state.size(); i++, slot += capacity)
+        *slot = Vector(state.x[i], state.y[i]);
+
+    head = (head + 1) % capacity;
+    if (count < capacity) count++;
+}
@@ -0,0 +1,68 @@
+/**
+ * Trail history of a flock.
+ */
+#pragma once
+
+#include <vector>
+
+#include "mobile.hpp"
+#include "vector.hpp"
+
+/**
+ * Last positions of every boid, stored in one contiguous array laid out
+ * [boid][length]. Each boid's row is a ring buffer; since every boid
+ * records at each step they all share the same write slot.
+ */
+class Trails
+{
+    unsigned capacity = 0;  // Positions kept per boid
+    unsigned head = 0;      // Slot of the next record
+    unsigned count = 0;     // Positions recorded so far, up to capacity
+    std::vector<Vector> points;
+
+   public:
+    /**
+     * Forget the history and keep length positions per boid.
+     */
+    void reset(unsigned boids, unsigned length);
+
+    void add(const Vector &position);
+
+    /**
+     * Start the trail of a boid over at a position.
+     */
+    void restart(unsigned boid, const Vector &position);
+
+    /**
+     * Remove the trails of the boids [first, last).
+     */
+    void erase(unsigned first, unsigned last);
+
+    /**
+     * Move the trails of the boids [middle, last) before those of
+     * [first, middle), as std::rotate.
+     */
+    void rotate(unsigned first, unsigned middle, unsigned last);
+
+    /**
+     * Record the current position of every boid, one store per boid.
+     */
+    void record(const Kinematics &state);
+
+    unsigned boids() const { return capacity ? points.size() / capacity : 0; }
+    unsigned length() const { return capacity; }
+    unsigned size() const { return count; }
+
+    /**
+     * Position of a boid age steps ago, 0 being the last record.
+     */
+    const Vector &at(unsigned boid, unsigned age) const
+    {
+        return points[boid * capacity + (head + capacity - 1 - age) % capacity];
+    }
+
+    /**
+     * The whole [boid][length] array, e.g. for the renderer.
+     */
+    const Vector *data() const { return points.data(); }
+};
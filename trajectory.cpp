@@ -0,0 +1,298 @@
+/**
+ * Recording and replay of the states of a flock.
+ */
+#include "trajectory.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+static const char magic[8] = {'B', 'O', 'I', 'D', 'S', 'T', 'R', 'J'};
+static const char indexMagic[8] = {'B', 'O', 'I', 'D', 'S', 'I', 'D', 'X'};
+static const size_t headerSize = 112;
+static const size_t frameHeaderSize = 8;
+
+// Range of the quantized positions, bouncing boids may stray a little
+// outside of the unit square
+static const real positionMin = -0.5, positionMax = 1.5;
+
+template <typename T>
+static void put(std::vector<char> &bytes, T value)
+{
+    const char *p = reinterpret_cast<const char *>(&value);
+    bytes.insert(bytes.end(), p, p + sizeof(T));
+}
+
+template <typename T>
+static T get(const char *p)
+{
+    T value;
+    std::memcpy(&value, p, sizeof(T));
+    return value;
+}
+
+static uint16_t quantize(real value, real min, real max)
+{
+    real t = std::min(std::max((value - min) / (max - min), real(0)), real(1));
+    return static_cast<uint16_t>(std::lround(t * 65535));
+}
+
+static real dequantize(uint16_t value, real min, real max)
+{
+    return min + (max - min) * value / real(65535);
+}
+
+static size_t frameSize(unsigned boids, bool quantized)
+{
+    return frameHeaderSize + size_t(boids) * 4 * (quantized ? 2 : 4);
+}
+
+bool TrajectoryWriter::open(const std::string &path, const Flock &flock,
+                            double rate, bool quantize)
+{
+    close();
+
+    out.open(path, std::ios::binary | std::ios::trunc);
+    if (!out) return false;
+
+    header = TrajectoryHeader();
+    header.flags = (quantize ? TrajectoryHeader::Quantized : 0u) |
+                   (flock.wrap ? TrajectoryHeader::Wrap : 0u);
+    header.rate = rate;
+    header.cohesion = flock.cohesion;
+    header.cohesionRadius = flock.cohesionRadius;
+    header.separation = flock.separation;
+    header.separationRadius = flock.separationRadius;
+    header.alignment = flock.alignment;
+    header.alignmentRadius = flock.alignmentRadius;
+    header.fear = flock.fear;
+    header.fearRadius = flock.fearRadius;
+    header.fieldOfView = flock.fieldOfView;
+    header.maxVelocity = 0;
+    for (unsigned s = 0; s < flock.speciesCount(); s++)
+        header.maxVelocity =
+            std::max(header.maxVelocity, flock.species(s).maxVelocity);
+    header.tailLength = flock.tailLength;
+
+    bytes.clear();
+    bytes.insert(bytes.end(), magic, magic + sizeof(magic));
+    put(bytes, header.version);
+    put(bytes, header.flags);
+    for (double value :
+         {header.rate, header.cohesion, header.cohesionRadius,
+          header.separation, header.separationRadius, header.alignment,
+          header.alignmentRadius, header.fear, header.fearRadius,
+          header.fieldOfView, header.maxVelocity})
+        put(bytes, value);
+    put(bytes, header.tailLength);
+    put(bytes, uint32_t(0));
+    out.write(bytes.data(), bytes.size());
+
+    offset = bytes.size();
+    offsets.clear();
+    closing = false;
+    thread = std::thread(&TrajectoryWriter::run, this);
+    return true;
+}
+
+void TrajectoryWriter::write(const Kinematics &state)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (spare.empty()) {
+            queue.emplace_back();
+        } else {
+            queue.push_back(std::move(spare.back()));
+            spare.pop_back();
+        }
+        queue.back() = state;
+    }
+    ready.notify_one();
+}
+
+void TrajectoryWriter::close()
+{
+    if (!thread.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closing = true;
+    }
+    ready.notify_one();
+    thread.join();
+
+    bytes.clear();
+    for (uint64_t frame : offsets) put(bytes, frame);
+    put(bytes, uint64_t(offsets.size()));
+    bytes.insert(bytes.end(), indexMagic, indexMagic + sizeof(indexMagic));
+    out.write(bytes.data(), bytes.size());
+    out.close();
+}
+
+void TrajectoryWriter::run()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+        ready.wait(lock, [&] { return closing || !queue.empty(); });
+        if (queue.empty()) return;
+
+        Kinematics state = std::move(queue.front());
+        queue.pop_front();
+
+        lock.unlock();
+        encode(state);
+        out.write(bytes.data(), bytes.size());
+        offsets.push_back(offset);
+        offset += bytes.size();
+        lock.lock();
+
+        spare.push_back(std::move(state));
+    }
+}
+
+void TrajectoryWriter::encode(const Kinematics &state)
+{
+    unsigned n = state.size();
+    bytes.clear();
+    bytes.reserve(frameSize(n, header.quantized()));
+    put(bytes, uint32_t(n));
+    put(bytes, uint32_t(0));
+
+    real v = header.maxVelocity;
+    if (header.quantized()) {
+        for (auto *block : {&state.x, &state.y})
+            for (real p : *block)
+                put(bytes, quantize(p, positionMin, positionMax));
+        for (auto *block : {&state.vx, &state.vy})
+            for (real u : *block) put(bytes, quantize(u, -v, v));
+    } else {
+        for (auto *block : {&state.x, &state.y, &state.vx, &state.vy})
+            for (real value : *block) put(bytes, float(value));
+    }
+}
+
+bool TrajectoryReader::open(const std::string &path)
+{
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat info;
+    if (fstat(fd, &info) < 0 || size_t(info.st_size) < headerSize) {
+        ::close(fd);
+        return false;
+    }
+    length = info.st_size;
+    void *mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        length = 0;
+        return false;
+    }
+    data = static_cast<const char *>(mapping);
+
+    if (std::memcmp(data, magic, sizeof(magic))) {
+        close();
+        return false;
+    }
+
+    const char *p = data + sizeof(magic);
+    head.version = get<uint32_t>(p);
+    head.flags = get<uint32_t>(p + 4);
+    p += 8;
+    for (double *value :
+         {&head.rate, &head.cohesion, &head.cohesionRadius, &head.separation,
+          &head.separationRadius, &head.alignment, &head.alignmentRadius,
+          &head.fear, &head.fearRadius, &head.fieldOfView,
+          &head.maxVelocity}) {
+        *value = get<double>(p);
+        p += sizeof(double);
+    }
+    head.tailLength = get<int32_t>(p);
+
+    // The index at the end when the recording was closed properly,
+    // otherwise walk the frames
+    offsets.clear();
+    const char *end = data + length;
+    if (length >= headerSize + 16 &&
+        !std::memcmp(end - 8, indexMagic, sizeof(indexMagic))) {
+        uint64_t count = get<uint64_t>(end - 16);
+        if (count <= (length - headerSize - 16) / 8) {
+            const char *index = end - 16 - count * 8;
+            size_t limit = index - data;
+            for (uint64_t i = 0; i < count; i++) {
+                uint64_t at = get<uint64_t>(index + i * 8);
+                if (at < headerSize || at + frameHeaderSize > limit ||
+                    at + frameSize(get<uint32_t>(data + at),
+                                   head.quantized()) > limit)
+                    break;
+                offsets.push_back(at);
+            }
+            if (offsets.size() == count) return true;
+            offsets.clear();
+        }
+    }
+
+    size_t at = headerSize;
+    while (at + frameHeaderSize <= length) {
+        size_t size = frameSize(get<uint32_t>(data + at), head.quantized());
+        if (at + size > length) break;
+        offsets.push_back(at);
+        at += size;
+    }
+    return true;
+}
+
+void TrajectoryReader::close()
+{
+    if (data) munmap(const_cast<char *>(data), length);
+    data = nullptr;
+    length = 0;
+    offsets.clear();
+}
+
+unsigned TrajectoryReader::boids(unsigned frame) const
+{
+    return get<uint32_t>(data + offsets[frame]);
+}
+
+void TrajectoryReader::read(unsigned frame, Kinematics &state) const
+{
+    unsigned n = boids(frame);
+    const char *p = data + offsets[frame] + frameHeaderSize;
+    real v = head.maxVelocity;
+
+    std::vector<real> *blocks[] = {&state.x, &state.y, &state.vx, &state.vy};
+    for (unsigned b = 0; b < 4; b++) {
+        std::vector<real> &block = *blocks[b];
+        block.resize(n);
+        if (head.quantized()) {
+            real min = b < 2 ? positionMin : -v;
+            real max = b < 2 ? positionMax : v;
+            for (unsigned i = 0; i < n; i++, p += 2)
+                block[i] = dequantize(get<uint16_t>(p), min, max);
+        } else {
+            for (unsigned i = 0; i < n; i++, p += 4) block[i] = get<float>(p);
+        }
+    }
+}
+
+void TrajectoryReader::configure(Flock &flock) const
+{
+    flock.cohesion = head.cohesion;
+    flock.cohesionRadius = head.cohesionRadius;
+    flock.separation = head.separation;
+    flock.separationRadius = head.separationRadius;
+    flock.alignment = head.alignment;
+    flock.alignmentRadius = head.alignmentRadius;
+    flock.fear = head.fear;
+    flock.fearRadius = head.fearRadius;
+    flock.fieldOfView = head.fieldOfView;
+    flock.maxVelocity = head.maxVelocity;
+    flock.tailLength = head.tailLength;
+    flock.wrap = head.flags & TrajectoryHeader::Wrap;
+}
@@ -0,0 +1,141 @@
+/**
+ * Recording and replay of the states of a flock.
+ */
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "flock.hpp"
+#include "mobile.hpp"
+
+/**
+ * A trajectory file is a header, the frames one after the other, then an
+ * index of the frame offsets written on close. Everything is in the byte
+ * order of the machine (little-endian on all the targets).
+ *
+ *   header  "BOIDSTRJ", version, flags, rate, parameters of the flock
+ *   frame   boid count, then x, y, vx and vy each as one block, in floats
+ *           or, quantized, positions in 16 bits over [-0.5, 1.5] and
+ *           velocities in 16 bits over [-maxVelocity, maxVelocity]
+ *   index   one 64-bit offset per frame, the frame count, "BOIDSIDX"
+ *
+ * The index is what makes seeking O(1). A file whose recording was cut
+ * short has none, its frames are then found by walking them once.
+ */
+struct TrajectoryHeader {
+    enum Flags : uint32_t { Quantized = 1, Wrap = 2 };
+
+    uint32_t version = 1;
+    uint32_t flags = 0;
+    double rate = 0;  // Steps per second
+
+    // Parameters of the flock, see flock.hpp
+    double cohesion = 0, cohesionRadius = 0;
+    double separation = 0, separationRadius = 0;
+    double alignment = 0, alignmentRadius = 0;
+    double fear = 0, fearRadius = 0;
+    double fieldOfView = 0;
+    double maxVelocity = 0;  // Of the fastest species
+    int32_t tailLength = 0;
+
+    bool quantized() const { return flags & Quantized; }
+};
+
+/**
+ * Writes the states of a flock to a trajectory file. write() only copies
+ * the state, the encoding and the file writes happen on a thread of the
+ * writer so the simulation is not slowed down by the disk.
+ */
+class TrajectoryWriter
+{
+    std::ofstream out;
+    TrajectoryHeader header;
+    std::vector<uint64_t> offsets;
+    uint64_t offset = 0;
+    std::vector<char> bytes;  // Encoded frame
+
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<Kinematics> queue;  // Waiting to be written
+    std::vector<Kinematics> spare;  // Written, storage kept for reuse
+    bool closing = false;
+
+    void run();
+    void encode(const Kinematics &state);
+
+   public:
+    TrajectoryWriter() = default;
+    ~TrajectoryWriter() { close(); }
+
+    TrajectoryWriter(const TrajectoryWriter &) = delete;
+    TrajectoryWriter &operator=(const TrajectoryWriter &) = delete;
+
+    /**
+     * Start a file with the parameters of the flock, stepped rate times
+     * per second. Returns false if the file cannot be created.
+     */
+    bool open(const std::string &path, const Flock &flock, double rate,
+              bool quantize = false);
+
+    bool isOpen() const { return thread.joinable(); }
+
+    /**
+     * Append a frame.
+     */
+    void write(const Kinematics &state);
+
+    /**
+     * Write the pending frames and the index.
+     */
+    void close();
+};
+
+/**
+ * Reads a trajectory file mapped in memory: any frame is decoded straight
+ * from the mapping, without reading the ones before.
+ */
+class TrajectoryReader
+{
+    const char *data = nullptr;
+    size_t length = 0;
+    TrajectoryHeader head;
+    std::vector<uint64_t> offsets;
+
+   public:
+    TrajectoryReader() = default;
+    ~TrajectoryReader() { close(); }
+
+    TrajectoryReader(const TrajectoryReader &) = delete;
+    TrajectoryReader &operator=(const TrajectoryReader &) = delete;
+
+    /**
+     * Returns false if the file cannot be mapped or is not a trajectory.
+     */
+    bool open(const std::string &path);
+    void close();
+
+    const TrajectoryHeader &header() const { return head; }
+    unsigned frames() const { return offsets.size(); }
+
+    unsigned boids(unsigned frame) const;
+
+    /**
+     * Decode a frame into state, resized to its boid count.
+     */
+    void read(unsigned frame, Kinematics &state) const;
+
+    /**
+     * Give a flock the parameters of the recording, those of its first
+     * species but for the speed limit, the fastest species'.
+     */
+    void configure(Flock &flock) const;
+};
@@ -0,0 +1,52 @@
+/**
+ * Lock-free hand over of values from one thread to another.
+ */
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+/**
+ * Three slots shared by one writer and one reader. The writer fills its
+ * back slot and swaps it with the middle one; the reader swaps its front
+ * slot with the middle one when something newer was published there.
+ * Neither ever waits for the other. The reader may skip values but always
+ * gets the latest one.
+ */
+template <typename T>
+class TripleBuffer
+{
+    static constexpr uint8_t fresh = 4;  // Set on middle when published
+
+    T slots[3];
+    std::atomic<uint8_t> middle{1};
+    uint8_t writing = 0;  // Back slot, the writer's
+    uint8_t reading = 2;  // Front slot, the reader's
+
+   public:
+    /**
+     * Slot to fill before publish(), writer thread only.
+     */
+    T &back() { return slots[writing]; }
+
+    /**
+     * Make the back slot the latest value.
+     */
+    void publish()
+    {
+        writing = middle.exchange(writing | fresh, std::memory_order_acq_rel) & 3;
+    }
+
+    /**
+     * Take the latest value if one was published since the last call,
+     * reader thread only. Returns whether front() changed.
+     */
+    bool update()
+    {
+        if (!(middle.load(std::memory_order_relaxed) & fresh)) return false;
+        reading = middle.exchange(reading, std::memory_order_acq_rel) & 3;
+        return true;
+    }
+
+    const T &front() const { return slots[reading]; }
+};
@@ -2,54 +2,140 @@
  * 2D Vector in a vector space.
  */
 #pragma once
+#include <cmath>
 #include <iostream>
+#include <sstream>
+#include <string>
 
-class Vector
+/**
+ * Scalar type of the simulation, single precision when built with
+ * BOIDS_SINGLE_PRECISION (make PRECISION=single).
+ */
+#ifdef BOIDS_SINGLE_PRECISION
+using real = float;
+#else
+using real = double;
+#endif
+
+template <typename T>
+class BasicVector
 {
 public:
-    double x;
-    double y;
-
-    Vector();
-    Vector(double x, double y);
-
-    Vector operator+(const double scalar);
-    Vector operator-(const double scalar);
-    Vector operator*(const double scalar);
-    Vector operator/(const double scalar);
-
-    Vector operator+(const Vector &vector);
-    Vector operator-(const Vector &vector);
-    Vector operator*(const Vector &vector);
-    Vector operator/(const Vector &vector);
-
-    Vector &operator*=(double scalar);
-    Vector &operator/=(double scalar);
-    Vector &operator+=(double scalar);
-    Vector &operator+=(Vector Vector);
-    Vector &operator-=(double scalar);
-    Vector &operator-=(Vector Vector);
-
-    bool operator==(const Vector& vector) const;
-    bool operator!=(const Vector& vector) const;
-
-
-    void fmod(double mod);
-
-    Vector &normalize();
-    Vector &limit(double max = 1.0);
-    Vector &rotate(double angle);
-    
-    double distance(Vector other) const;
-    double toroidal_distance(const Vector &other, double width = 1.0, double height = 1.0) const;
-    double toroidal_distance2(const Vector &other, double width = 1.0, double height = 1.0) const;
-    double norm() const;
-    double angle() const;
-    double angle(const Vector &other) const;
-
-    static Vector random(double max = 1.0, double offset = 0.0);
-
-    operator std::string () const;
-    friend std::ostream &operator<<(std::ostream &os, const Vector &vector);
+    using value_type = T;
+
+    T x;
+    T y;
+
+    constexpr BasicVector() : x{0}, y{0} {}
+    constexpr BasicVector(T x, T y) : x{x}, y{y} {}
+
+    template <typename U>
+    constexpr explicit BasicVector(const BasicVector<U> &other)
+        : x{static_cast<T>(other.x)}, y{static_cast<T>(other.y)}
+    {
+    }
+
+    constexpr BasicVector operator+(const T scalar) const { return BasicVector(x + scalar, y + scalar); }
+    constexpr BasicVector operator-(const T scalar) const { return BasicVector(x - scalar, y - scalar); }
+    constexpr BasicVector operator*(const T scalar) const { return BasicVector(x * scalar, y * scalar); }
+    constexpr BasicVector operator/(const T scalar) const { return BasicVector(x / scalar, y / scalar); }
+
+    constexpr BasicVector operator+(const BasicVector &other) const { return BasicVector(x + other.x, y + other.y); }
+    constexpr BasicVector operator-(const BasicVector &other) const { return BasicVector(x - other.x, y - other.y); }
+    constexpr BasicVector operator*(const BasicVector &other) const { return BasicVector(x * other.x, y * other.y); }
+    constexpr BasicVector operator/(const BasicVector &other) const { return BasicVector(x / other.x, y / other.y); }
+
+    constexpr BasicVector &operator*=(T scalar) { x *= scalar; y *= scalar; return *this; }
+    constexpr BasicVector &operator/=(T scalar) { x /= scalar; y /= scalar; return *this; }
+    constexpr BasicVector &operator+=(T scalar) { x += scalar; y += scalar; return *this; }
+    constexpr BasicVector &operator-=(T scalar) { x -= scalar; y -= scalar; return *this; }
+    constexpr BasicVector &operator+=(const BasicVector &other) { x += other.x; y += other.y; return *this; }
+    constexpr BasicVector &operator-=(const BasicVector &other) { x -= other.x; y -= other.y; return *this; }
+
+    constexpr bool operator==(const BasicVector &other) const { return x == other.x && y == other.y; }
+    constexpr bool operator!=(const BasicVector &other) const { return x != other.x || y != other.y; }
+
+    constexpr T dot(const BasicVector &other) const { return x * other.x + y * other.y; }
+    constexpr T norm2() const { return x * x + y * y; }
+
+    T norm() const { return std::sqrt(norm2()); }
+
+    void fmod(T mod)
+    {
+        x = std::fmod(x, mod);
+        y = std::fmod(y, mod);
+    }
+
+    BasicVector &normalize()
+    {
+        T magnitude = norm();
+        if (magnitude != 0) *this /= magnitude;
+        return *this;
+    }
+
+    BasicVector &limit(T max = 1)
+    {
+        T magnitude = norm();
+        if (magnitude > max) *this *= max / magnitude;
+        return *this;
+    }
+
+    BasicVector &rotate(T angle)
+    {
+        T c = std::cos(angle), s = std::sin(angle);
+        *this = BasicVector(x * c - y * s, x * s + y * c);
+        return *this;
+    }
+
+    T distance(const BasicVector &other) const { return (*this - other).norm(); }
+
+    /**
+     * Toroidal distance in a Wrap Around space.
+     * @param other Other vector point
+     * @param width Width of the vector space
+     * @param height Height of the vector space
+     */
+    T toroidal_distance2(const BasicVector &other, T width = 1, T height = 1) const
+    {
+        T dx = std::fabs(x - other.x);
+        T dy = std::fabs(y - other.y);
+
+        dx = dx > width / 2 ? width - dx : dx;
+        dy = dy > height / 2 ? height - dy : dy;
+
+        return dx * dx + dy * dy;
+    }
+
+    T toroidal_distance(const BasicVector &other, T width = 1, T height = 1) const
+    {
+        return std::sqrt(toroidal_distance2(other, width, height));
+    }
+
+    T angle() const { return std::atan2(y, x); }
+    T angle(const BasicVector &other) const { return std::atan2(other.y - y, other.x - x); }
+
+    /**
+     * Both components uniform in [offset, offset + max), drawn from a
+     * generator such as Random::Stream.
+     */
+    template <typename Generator>
+    static BasicVector random(Generator &generator, T max = 1, T offset = 0)
+    {
+        T x = generator.uniform(max, offset);
+        return BasicVector(x, generator.uniform(max, offset));
+    }
+
+    operator std::string () const
+    {
+        std::stringstream ss;
+        ss << "(" << x << ", " << y << ")";
+        return ss.str();
+    }
+
+    friend std::ostream &operator<<(std::ostream &os, const BasicVector &vector)
+    {
+        return os << static_cast<std::string>(vector);
+    }
 };
 
+using Vector = BasicVector<real>;